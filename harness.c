@@ -43,6 +43,7 @@ typedef struct BELE {
 
 static block_ele_t *allocated = NULL;
 static size_t allocated_count = 0;
+static size_t allocated_bytes = 0;
 
 /* Percent probability of malloc failure */
 int fail_probability = 0;
@@ -52,7 +53,7 @@ static bool noallocate_mode = false;
 static bool error_occurred = false;
 static char *error_message = "";
 
-static int time_limit = 1;
+int time_limit = 1;
 
 /*
  * Data for managing exceptions
@@ -157,6 +158,7 @@ void *test_malloc(size_t size)
         allocated->prev = new_block;
     allocated = new_block;
     allocated_count++;
+    allocated_bytes += size;
 
     return p;
 }
@@ -206,6 +208,7 @@ void test_free(void *p)
     if (bn)
         bn->prev = bp;
 
+    allocated_bytes -= b->payload_size;
     free(b);
     allocated_count--;
 }
@@ -221,11 +224,22 @@ char *test_strdup(const char *s)
     return (char *) memcpy(new, s, len);
 }
 
+void test_alloc_error(char *msg, void *p)
+{
+    report_event(MSG_ERROR, "%s.  Address = %p", msg, p);
+    error_occurred = true;
+}
+
 size_t allocation_check()
 {
     return allocated_count;
 }
 
+size_t allocation_bytes()
+{
+    return allocated_bytes;
+}
+
 /*
  * Implementation of functions for testing
  */
@@ -17,14 +17,26 @@ void test_free(void *p);
 char *test_strdup(const char *s);
 /* FIXME: provide test_realloc as well */
 
+/*
+ * Report misuse detected by an allocator layered on top of test_malloc,
+ * such as a corrupted object inside a slab. Flags an error like test_free.
+ */
+void test_alloc_error(char *msg, void *p);
+
 #ifdef INTERNAL
 
 /* Report number of allocated blocks */
 size_t allocation_check();
 
+/* Report number of bytes requested by the allocated blocks */
+size_t allocation_bytes();
+
 /* Probability of malloc failing, expressed as percent */
 extern int fail_probability;
 
+/* Time limit, in seconds, for each operation run under exception_setup */
+extern int time_limit;
+
 /*
  * Set/unset cautious mode.
  * In this mode, makes extra sure any block to be freed is currently allocated.
@@ -0,0 +1,130 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "intern.h"
+#include "slab.h"
+
+/* Buckets of a new table, doubled whenever the strings outnumber them */
+#define INTERN_MIN_BUCKETS 64
+
+int intern_mode = 0;
+
+/* Unique string with its header, allocated from the slab pool like elements */
+typedef struct entry {
+    struct entry *next; /* next entry of the bucket */
+    uint64_t hash;
+    size_t refs;
+    size_t len;
+    char str[];
+} entry_t;
+
+static entry_t **buckets = NULL;
+static size_t nbuckets = 0;
+static intern_stats_t usage = {0, 0, 0, 0};
+
+/* FNV-1a over the bytes of s, then a splitmix64 finalizer */
+static uint64_t hash_string(const char *s, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char) s[i]) * 0x100000001b3;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+    return h ^ (h >> 31);
+}
+
+/*
+ * Double the number of buckets, or allocate the first ones.
+ * Return false if could not allocate space, leaving the table as it was.
+ */
+static bool table_grow()
+{
+    size_t n = nbuckets ? 2 * nbuckets : INTERN_MIN_BUCKETS;
+    entry_t **b = malloc(n * sizeof(entry_t *));
+    if (!b)
+        return false;
+    memset(b, 0, n * sizeof(entry_t *));
+
+    for (size_t i = 0; i < nbuckets; i++) {
+        for (entry_t *e = buckets[i], *next; e; e = next) {
+            next = e->next;
+            e->next = b[e->hash & (n - 1)];
+            b[e->hash & (n - 1)] = e;
+        }
+    }
+    free(buckets);
+    usage.table_bytes += (n - nbuckets) * sizeof(entry_t *);
+    buckets = b;
+    nbuckets = n;
+    return true;
+}
+
+char *intern_get(const char *s, size_t len)
+{
+    uint64_t hash = hash_string(s, len);
+
+    if (nbuckets) {
+        for (entry_t *e = buckets[hash & (nbuckets - 1)]; e; e = e->next) {
+            if (e->hash == hash && e->len == len && !memcmp(e->str, s, len)) {
+                e->refs++;
+                usage.refs++;
+                usage.copy_bytes += len;
+                return e->str;
+            }
+        }
+    }
+
+    // A failure to grow only lengthens the chains while there are buckets
+    if (usage.unique >= nbuckets && !table_grow() && !nbuckets)
+        return NULL;
+    entry_t *e = slab_alloc(sizeof(entry_t) + len + 1);
+    if (!e)
+        return NULL;
+    memcpy(e->str, s, len);
+    e->str[len] = '\0';
+    e->hash = hash;
+    e->refs = 1;
+    e->len = len;
+    e->next = buckets[hash & (nbuckets - 1)];
+    buckets[hash & (nbuckets - 1)] = e;
+
+    usage.unique++;
+    usage.refs++;
+    usage.copy_bytes += len;
+    usage.table_bytes += sizeof(entry_t) + len + 1;
+    return e->str;
+}
+
+void intern_put(char *s)
+{
+    entry_t *e = (entry_t *) (s - offsetof(entry_t, str));
+    usage.refs--;
+    usage.copy_bytes -= e->len;
+    if (--e->refs)
+        return;
+
+    entry_t **p = &buckets[e->hash & (nbuckets - 1)];
+    while (*p != e)
+        p = &(*p)->next;
+    *p = e->next;
+    usage.unique--;
+    usage.table_bytes -= sizeof(entry_t) + e->len + 1;
+    slab_free(e);
+
+    // Hand the buckets back with the last string
+    if (!usage.unique) {
+        free(buckets);
+        buckets = NULL;
+        nbuckets = 0;
+        usage.table_bytes = 0;
+    }
+}
+
+void intern_get_stats(intern_stats_t *stats)
+{
+    *stats = usage;
+}
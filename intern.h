@@ -0,0 +1,50 @@
+#ifndef LAB0_INTERN_H
+#define LAB0_INTERN_H
+
+/*
+ * Interning table for queue strings.
+ *
+ * While interning is enabled, inserts look their string up in a hash table
+ * of unique strings and point the element at the shared copy instead of
+ * storing one of their own. Each copy counts its references and is handed
+ * back to free with the last one, and the table itself once it holds no
+ * string, so allocation_check() still counts leaked elements as soon as
+ * every queue has been freed.
+ *
+ * Two interned strings are equal exactly when they are the same pointer.
+ */
+
+#include <stddef.h>
+
+/* Intern strings of new elements when set, may be changed at any time */
+extern int intern_mode;
+
+/*
+ * Return the shared copy of string s of length len, adding a reference to
+ * it.
+ * Return NULL if could not allocate space.
+ */
+char *intern_get(const char *s, size_t len);
+
+/*
+ * Drop a reference to a string returned by intern_get, releasing it with
+ * the last one
+ */
+void intern_put(char *s);
+
+/* Usage of the table */
+typedef struct {
+    size_t unique; /* strings held */
+    size_t refs;   /* references to them */
+    /*
+     * Bytes of string the references would take as copies of their own,
+     * short of the terminator: an element keeps a tag byte in its place
+     */
+    size_t copy_bytes;
+    /* Bytes taken by the table: strings, their headers and the buckets */
+    size_t table_bytes;
+} intern_stats_t;
+
+void intern_get_stats(intern_stats_t *stats);
+
+#endif /* LAB0_INTERN_H */
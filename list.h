@@ -334,6 +334,158 @@ static inline void list_move_tail(struct list_head *node,
     list_add_tail(node, head);
 }
 
+/**
+ * list_cmp_func_t - Comparison callback of list_sort
+ * @priv: private data handed to list_sort, passed through untouched
+ * @a: pointer to the first list node
+ * @b: pointer to the second list node
+ *
+ * Return: >0 if @a must be placed after @b, <=0 otherwise. The sort is
+ * stable: nodes comparing equal keep their original order.
+ */
+typedef int (*list_cmp_func_t)(void *priv,
+                               const struct list_head *a,
+                               const struct list_head *b);
+
+/* Merge two null-terminated runs into one, prev links left unset */
+static inline struct list_head *__list_merge(void *priv,
+                                             list_cmp_func_t cmp,
+                                             struct list_head *a,
+                                             struct list_head *b)
+{
+    struct list_head *head = NULL, **tail = &head;
+
+    for (;;) {
+        /* if equal, take 'a' -- important for sort stability */
+        if (cmp(priv, a, b) <= 0) {
+            *tail = a;
+            tail = &a->next;
+            a = a->next;
+            if (!a) {
+                *tail = b;
+                break;
+            }
+        } else {
+            *tail = b;
+            tail = &b->next;
+            b = b->next;
+            if (!b) {
+                *tail = a;
+                break;
+            }
+        }
+    }
+    return head;
+}
+
+/* Merge the last two runs into @head, restoring the prev links */
+static inline void __list_merge_final(void *priv,
+                                      list_cmp_func_t cmp,
+                                      struct list_head *head,
+                                      struct list_head *a,
+                                      struct list_head *b)
+{
+    struct list_head *tail = head;
+
+    for (;;) {
+        /* if equal, take 'a' -- important for sort stability */
+        if (cmp(priv, a, b) <= 0) {
+            tail->next = a;
+            a->prev = tail;
+            tail = a;
+            a = a->next;
+            if (!a)
+                break;
+        } else {
+            tail->next = b;
+            b->prev = tail;
+            tail = b;
+            b = b->next;
+            if (!b) {
+                b = a;
+                break;
+            }
+        }
+    }
+
+    /* Finish linking remainder of list b on to tail */
+    tail->next = b;
+    do {
+        b->prev = tail;
+        tail = b;
+        b = b->next;
+    } while (b);
+
+    tail->next = head;
+    head->prev = tail;
+}
+
+/**
+ * list_sort() - Sort a list with a comparison callback
+ * @priv: private data, passed to @cmp
+ * @head: pointer to the head of the list
+ * @cmp: comparison function, see list_cmp_func_t
+ *
+ * Stable bottom-up merge sort, following the Linux kernel's list_sort. The
+ * nodes are pushed one by one onto a stack of pending runs, linked through
+ * their prev pointers, and two runs of equal size 2^k are merged as soon as
+ * a third one would follow them. Merges stay balanced at 2:1 at worst, so
+ * the sort makes close to n * log2(n) comparisons while no more than
+ * log2(n) runs are ever pending, and needs no memory besides the nodes.
+ */
+static inline void list_sort(void *priv,
+                             struct list_head *head,
+                             list_cmp_func_t cmp)
+{
+    struct list_head *list = head->next, *pending = NULL;
+    size_t count = 0; /* Count of pending */
+
+    if (list == head->prev) /* Zero or one elements */
+        return;
+
+    /* Convert to a null-terminated singly-linked list. */
+    head->prev->next = NULL;
+
+    do {
+        size_t bits;
+        struct list_head **tail = &pending;
+
+        /* Find the least-significant clear bit in count */
+        for (bits = count; bits & 1; bits >>= 1)
+            tail = &(*tail)->prev;
+        /* Do the indicated merge */
+        if (bits) {
+            struct list_head *a = *tail, *b = a->prev;
+
+            a = __list_merge(priv, cmp, b, a);
+            /* Install the merged result in place of the inputs */
+            a->prev = b->prev;
+            *tail = a;
+        }
+
+        /* Move one element from input list to pending */
+        list->prev = pending;
+        pending = list;
+        list = list->next;
+        pending->next = NULL;
+        count++;
+    } while (list);
+
+    /* End of input; merge together all the pending lists. */
+    list = pending;
+    pending = pending->prev;
+    for (;;) {
+        struct list_head *next = pending->prev;
+
+        if (!next)
+            break;
+        list = __list_merge(priv, cmp, pending, list);
+        pending = next;
+    }
+    /* The final merge, rebuilding prev links */
+    __list_merge_final(priv, cmp, head, pending, list);
+}
+
 /**
  * list_entry() - Calculate address of entry that contains list node
  * @node: pointer to list node
@@ -428,6 +580,80 @@ static inline void list_move_tail(struct list_head *node,
          &entry->member != (head); entry = safe,                           \
         safe = list_entry(safe->member.next, __typeof__(*entry), member))
 
+/**
+ * struct list_ends - Cursors of list_for_each_ends
+ * @front: next node to visit from the front
+ * @back: next node to visit from the back
+ * @from_back: whether the current node was reached from the back
+ * @last: whether the current node is the last one to visit
+ */
+struct list_ends {
+    struct list_head *front, *back;
+    int from_back, last;
+};
+
+/*
+ * Return the next node of a walk from both ends, NULL after the last one.
+ * The cursor moves past the node before handing it out, so the node may be
+ * removed.
+ */
+static inline struct list_head *__list_ends_next(struct list_ends *ends)
+{
+    struct list_head *node;
+
+    if (ends->last)
+        return NULL;
+    ends->from_back = !ends->from_back;
+    if (!ends->from_back) {
+        node = ends->front;
+        if (node == ends->back)
+            ends->last = 1;
+        else
+            ends->front = node->next;
+    } else {
+        node = ends->back;
+        if (node == ends->front)
+            ends->last = 1;
+        else
+            ends->back = node->prev;
+    }
+    return node;
+}
+
+/* Return the first node of a walk from both ends, NULL if the list is empty */
+static inline struct list_head *__list_ends_first(struct list_ends *ends,
+                                                  struct list_head *head)
+{
+    ends->front = head->next;
+    ends->back = head->prev;
+    ends->from_back = 1;
+    ends->last = head->next == head;
+    return __list_ends_next(ends);
+}
+
+/**
+ * list_for_each_ends - iterate over list nodes from both ends at once
+ * @node: list_head pointer used as iterator
+ * @ends: struct list_ends used to store the cursors
+ * @head: pointer to the head of the list
+ *
+ * Visit the first node, then the last, the second, the second to last and
+ * so on until both ends meet. Walking a list that does not fit in the cache
+ * waits for one miss per node, as the address of the next node is only
+ * known once the current one is loaded: prefetching further ahead cannot
+ * help, since the prefetches would have to chase the same pointers. Two
+ * cursors chasing the next and the prev pointers are independent, and the
+ * CPU overlaps their misses, for up to twice the speed of list_for_each
+ * when the order of the visit does not matter. ends.from_back tells which
+ * end the current node was reached from.
+ *
+ * The current node (iterator) is allowed to be removed from the list. Any
+ * other modifications to the the list will cause undefined behavior.
+ */
+#define list_for_each_ends(node, ends, head)                \
+    for (node = __list_ends_first(&(ends), (head)); node; \
+         node = __list_ends_next(&(ends)))
+
 #undef __LIST_HAVE_TYPEOF
 
 #ifdef __cplusplus
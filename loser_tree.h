@@ -0,0 +1,69 @@
+#ifndef LAB0_LOSER_TREE_H
+#define LAB0_LOSER_TREE_H
+
+/*
+ * Loser tree (tournament tree) over the heads of k sorted sources, for the
+ * k-way merge of q_merge in every backend.
+ *
+ * Source i enters at leaf k + i of an implicit binary tree. Each inner node
+ * 1 .. k - 1 keeps the loser of the match played there, and tree[0] the
+ * overall winner. Once the head of the winner is taken, only the matches
+ * on its path to the root are replayed: log2(k) comparisons per element,
+ * against up to twice as many to sift down a binary heap.
+ *
+ * beats(ctx, a, b) tells whether the head of source a goes before the head
+ * of source b. An exhausted source must lose against any other, so that
+ * tree[0] is exhausted only when every source is.
+ */
+
+#include <stdbool.h>
+
+/* Most sources of a tree, so that trees and scratch space fit on the stack */
+#define LOSER_TREE_MAX 64
+
+typedef bool (*loser_tree_beats_t)(void *ctx, int a, int b);
+
+/*
+ * Play every match of the tree over sources 0 .. k - 1, 1 <= k <=
+ * LOSER_TREE_MAX
+ */
+static inline void loser_tree_build(int *tree,
+                                    int k,
+                                    loser_tree_beats_t beats,
+                                    void *ctx)
+{
+    int win[2 * LOSER_TREE_MAX];
+
+    for (int i = 0; i < k; i++)
+        win[k + i] = i;
+    for (int n = k - 1; n >= 1; n--) {
+        int a = win[2 * n], b = win[2 * n + 1];
+        bool a_wins = beats(ctx, a, b);
+        win[n] = a_wins ? a : b;
+        tree[n] = a_wins ? b : a;
+    }
+    tree[0] = win[1];
+}
+
+/*
+ * Replay the matches of source src, the last winner, after its head
+ * changed
+ */
+static inline void loser_tree_replay(int *tree,
+                                     int k,
+                                     int src,
+                                     loser_tree_beats_t beats,
+                                     void *ctx)
+{
+    int w = src;
+    for (int n = (k + src) / 2; n >= 1; n /= 2) {
+        if (beats(ctx, tree[n], w)) {
+            int t = tree[n];
+            tree[n] = w;
+            w = t;
+        }
+    }
+    tree[0] = w;
+}
+
+#endif /* LAB0_LOSER_TREE_H */
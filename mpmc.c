@@ -0,0 +1,269 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/*
+ * Nodes are allocated and freed by any thread at any time, so they come
+ * from the C library allocator: the allocator of the test harness keeps
+ * unsynchronized bookkeeping, and harness.h is not included here.
+ */
+#include "mpmc.h"
+
+/* Size of a cache line, the unit of false sharing between threads */
+#define CACHE_LINE 64
+
+/* Retirements between two attempts of a handle to advance the epoch */
+#define MPMC_ADVANCE_EVERY 64
+
+typedef struct mpmc_node {
+    element_t *e;
+    _Atomic(struct mpmc_node *) next;
+    /*
+     * Link in a limbo list. next stays as it was, since threads that loaded
+     * the node before it was unlinked may still read it, or even try to
+     * link a node after it if next were reset.
+     */
+    struct mpmc_node *retired;
+} mpmc_node_t;
+
+/*
+ * Per-thread state. Nodes retired by the thread wait in one of three limbo
+ * lists, by epoch of retirement, until no thread can still hold them.
+ */
+struct mpmc_handle {
+    mpmc_t *q;
+    atomic_bool taken;
+    /* Epoch of the current critical section times 2, plus 1 while inside */
+    atomic_ulong state;
+    /* Epoch the current critical section started in */
+    unsigned long epoch;
+    mpmc_node_t *limbo[3];
+    unsigned long limbo_epoch[3];
+    int retired;
+    char __pad[CACHE_LINE];
+};
+
+/*
+ * Queue descriptor. head and tail are padded apart rather than aligned,
+ * since the descriptor comes from malloc.
+ */
+struct mpmc {
+    _Atomic(mpmc_node_t *) head;
+    char __pad0[CACHE_LINE];
+    _Atomic(mpmc_node_t *) tail;
+    char __pad1[CACHE_LINE];
+    atomic_ulong epoch;
+    char __pad2[CACHE_LINE];
+    int nhandles;
+    mpmc_handle_t *handles;
+};
+
+/*
+ * Free a limbo list of retired nodes
+ */
+static void __mpmc_free_nodes(mpmc_node_t *n)
+{
+    while (n) {
+        mpmc_node_t *next = n->retired;
+        free(n);
+        n = next;
+    }
+}
+
+/*
+ * Advance the global epoch if every thread in a critical section has seen
+ * it. Failing to is harmless: nodes only wait longer.
+ */
+static void __mpmc_try_advance(mpmc_t *q)
+{
+    unsigned long epoch = atomic_load(&q->epoch);
+
+    for (int i = 0; i < q->nhandles; i++) {
+        unsigned long state = atomic_load(&q->handles[i].state);
+        if ((state & 1) && (state >> 1) != epoch)
+            return;
+    }
+    atomic_compare_exchange_strong(&q->epoch, &epoch, epoch + 1);
+}
+
+/*
+ * Enter a critical section: nodes reachable from the queue stay allocated
+ * until the matching __mpmc_exit().
+ */
+static void __mpmc_enter(mpmc_handle_t *h)
+{
+    unsigned long epoch = atomic_load(&h->q->epoch);
+
+    atomic_store(&h->state, epoch << 1 | 1);
+    // The announcement is visible before any node of the queue is loaded
+    atomic_thread_fence(memory_order_seq_cst);
+    h->epoch = epoch;
+
+    // Nodes retired two epochs ago or earlier are out of every reader's sight
+    for (int i = 0; i < 3; i++) {
+        if (h->limbo[i] && h->limbo_epoch[i] + 2 <= epoch) {
+            __mpmc_free_nodes(h->limbo[i]);
+            h->limbo[i] = NULL;
+        }
+    }
+}
+
+static void __mpmc_exit(mpmc_handle_t *h)
+{
+    atomic_store_explicit(&h->state, h->epoch << 1, memory_order_release);
+}
+
+/*
+ * Retire a node unlinked from the queue, within a critical section.
+ *
+ * The node is tagged with the global epoch read after the unlink rather
+ * than the epoch of the section, which may be one behind: a thread that
+ * entered in the newer epoch may have loaded the node before the unlink.
+ */
+static void __mpmc_retire(mpmc_handle_t *h, mpmc_node_t *n)
+{
+    unsigned long epoch = atomic_load(&h->q->epoch);
+    int i = epoch % 3;
+
+    // A list left from an older epoch of the same slot is already safe
+    if (h->limbo[i] && h->limbo_epoch[i] != epoch) {
+        __mpmc_free_nodes(h->limbo[i]);
+        h->limbo[i] = NULL;
+    }
+    h->limbo_epoch[i] = epoch;
+    n->retired = h->limbo[i];
+    h->limbo[i] = n;
+
+    if (++h->retired >= MPMC_ADVANCE_EVERY) {
+        h->retired = 0;
+        __mpmc_try_advance(h->q);
+    }
+}
+
+mpmc_t *mpmc_new(int max_threads)
+{
+    if (max_threads < 1)
+        return NULL;
+
+    mpmc_t *q = malloc(sizeof(mpmc_t));
+    if (!q)
+        return NULL;
+    q->handles = malloc(max_threads * sizeof(mpmc_handle_t));
+    mpmc_node_t *dummy = malloc(sizeof(mpmc_node_t));
+    if (!q->handles || !dummy) {
+        free(q->handles);
+        free(dummy);
+        free(q);
+        return NULL;
+    }
+
+    dummy->e = NULL;
+    atomic_init(&dummy->next, NULL);
+    atomic_init(&q->head, dummy);
+    atomic_init(&q->tail, dummy);
+    atomic_init(&q->epoch, 0);
+    q->nhandles = max_threads;
+    for (int i = 0; i < max_threads; i++) {
+        mpmc_handle_t *h = &q->handles[i];
+        h->q = q;
+        atomic_init(&h->taken, false);
+        atomic_init(&h->state, 0);
+        h->epoch = 0;
+        for (int j = 0; j < 3; j++) {
+            h->limbo[j] = NULL;
+            h->limbo_epoch[j] = 0;
+        }
+        h->retired = 0;
+    }
+    return q;
+}
+
+void mpmc_free(mpmc_t *q)
+{
+    if (!q)
+        return;
+    for (mpmc_node_t *n = atomic_load(&q->head), *next; n; n = next) {
+        next = atomic_load(&n->next);
+        free(n);
+    }
+    for (int i = 0; i < q->nhandles; i++) {
+        for (int j = 0; j < 3; j++)
+            __mpmc_free_nodes(q->handles[i].limbo[j]);
+    }
+    free(q->handles);
+    free(q);
+}
+
+mpmc_handle_t *mpmc_register(mpmc_t *q)
+{
+    for (int i = 0; i < q->nhandles; i++) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&q->handles[i].taken, &expected,
+                                           true))
+            return &q->handles[i];
+    }
+    return NULL;
+}
+
+void mpmc_unregister(mpmc_handle_t *h)
+{
+    atomic_store(&h->taken, false);
+}
+
+bool mpmc_enqueue(mpmc_handle_t *h, element_t *e)
+{
+    mpmc_node_t *n = malloc(sizeof(mpmc_node_t));
+    if (!n)
+        return false;
+    n->e = e;
+    atomic_init(&n->next, NULL);
+
+    mpmc_t *q = h->q;
+    __mpmc_enter(h);
+    for (;;) {
+        mpmc_node_t *tail = atomic_load(&q->tail);
+        mpmc_node_t *next = atomic_load(&tail->next);
+        if (tail != atomic_load(&q->tail))
+            continue;
+        if (next) {
+            // Help a lagging enqueue to swing the tail
+            atomic_compare_exchange_weak(&q->tail, &tail, next);
+            continue;
+        }
+        if (atomic_compare_exchange_weak(&tail->next, &next, n)) {
+            atomic_compare_exchange_strong(&q->tail, &tail, n);
+            break;
+        }
+    }
+    __mpmc_exit(h);
+    return true;
+}
+
+element_t *mpmc_dequeue(mpmc_handle_t *h)
+{
+    mpmc_t *q = h->q;
+    element_t *e = NULL;
+
+    __mpmc_enter(h);
+    for (;;) {
+        mpmc_node_t *head = atomic_load(&q->head);
+        mpmc_node_t *tail = atomic_load(&q->tail);
+        mpmc_node_t *next = atomic_load(&head->next);
+        if (head != atomic_load(&q->head))
+            continue;
+        if (!next)
+            break;
+        if (head == tail) {
+            atomic_compare_exchange_weak(&q->tail, &tail, next);
+            continue;
+        }
+        // Read before the swap: once head moves, next may be dequeued too
+        element_t *value = next->e;
+        if (atomic_compare_exchange_weak(&q->head, &head, next)) {
+            e = value;
+            __mpmc_retire(h, head);
+            break;
+        }
+    }
+    __mpmc_exit(h);
+    return e;
+}
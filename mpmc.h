@@ -0,0 +1,65 @@
+#ifndef LAB0_MPMC_H
+#define LAB0_MPMC_H
+
+/*
+ * Lock-free multi-producer/multi-consumer queue of elements.
+ *
+ * A Michael–Scott queue: a singly-linked list of nodes with a dummy node at
+ * its head, where enqueue links a node after the tail and dequeue moves the
+ * head forward, both with compare-and-swap. Nodes hold element_t pointers,
+ * so an element goes from one thread to another without being copied, and
+ * the thread that dequeues it owns it and may hand it to
+ * q_release_element().
+ *
+ * A dequeued node may still be read by threads that loaded it before it
+ * was unlinked, so it is retired rather than freed, with epoch-based
+ * reclamation: every operation runs inside a critical section tagged with
+ * the global epoch, the epoch only advances once every thread inside a
+ * critical section has seen it, and a node retired in epoch e is freed once
+ * the epoch has reached e + 2.
+ *
+ * Every thread using the queue works through its own handle, taken with
+ * mpmc_register() and given back with mpmc_unregister().
+ */
+
+#include <stdbool.h>
+
+#include "queue.h"
+
+typedef struct mpmc mpmc_t;
+typedef struct mpmc_handle mpmc_handle_t;
+
+/*
+ * Create an empty queue usable by up to max_threads threads at once.
+ * Return NULL if could not allocate space.
+ */
+mpmc_t *mpmc_new(int max_threads);
+
+/*
+ * Free the queue and its nodes, but not the elements left in it.
+ * No thread may hold a handle. No effect if q is NULL.
+ */
+void mpmc_free(mpmc_t *q);
+
+/*
+ * Take a handle for the calling thread.
+ * Return NULL if max_threads handles are already taken.
+ */
+mpmc_handle_t *mpmc_register(mpmc_t *q);
+
+/* Give back a handle. Nodes it retired are freed with the queue */
+void mpmc_unregister(mpmc_handle_t *h);
+
+/*
+ * Append element e to the queue.
+ * Return false if could not allocate a node.
+ */
+bool mpmc_enqueue(mpmc_handle_t *h, element_t *e);
+
+/*
+ * Take the oldest element of the queue.
+ * Return NULL if the queue is empty.
+ */
+element_t *mpmc_dequeue(mpmc_handle_t *h);
+
+#endif /* LAB0_MPMC_H */
@@ -2,13 +2,21 @@
 
 #include <errno.h>
 #include <getopt.h>
+#include <limits.h>
+#include <linux/perf_event.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <spawn.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h> /* strcasecmp */
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
@@ -18,6 +26,7 @@
 /* Our program needs to use regular malloc/free */
 #define INTERNAL 1
 #include "harness.h"
+#include "intern.h"
 
 /* What character limit will be used for displaying strings? */
 #define MAXSTRING 1024
@@ -32,9 +41,17 @@
  * solution code
  */
 #include "queue.h"
+#include "queue_bulk.h"
+#include "queue_iter.h"
+#include "queue_merge.h"
+#include "queue_sorted.h"
+#include "queue_take.h"
 
 #include "console.h"
+#include "mpmc.h"
 #include "report.h"
+#include "slab.h"
+#include "spsc.h"
 
 /* Settable parameters */
 
@@ -48,11 +65,73 @@
 #define BIG_LIST 30
 static int big_list_size = BIG_LIST;
 
+/* Default number of strings passed by the spsc command */
+#define SPSC_BENCH_N 1000000
+
+/* Capacity and publication batch of the queues of the spsc command */
+static int spsc_capacity = 1024;
+static int spsc_batch = 32;
+
+/* Default number of elements passed by the mpmc command */
+#define MPMC_BENCH_N 100000
+
+/* Upper bound of mpmc_threads */
+#define MPMC_MAX_THREADS 64
+
+/* Largest thread count of the mpmc command, 0 for the number of cores */
+static int mpmc_threads = 0;
+
+/* Seed for shuffle, 0 until set through the option command */
+static int shuffle_seed = 0;
+
+/*
+ * Insert and remove through the ownership-transferring calls of
+ * queue_take.h: ih and it hand over a harness-allocated copy of the string,
+ * rh and rt take the string back and free it
+ */
+static int take_mode = 0;
+
+/* Report the comparisons made by sort and the time it took */
+static int sort_stats = 0;
+
 /*
  *
  */
 void q_shuffle(struct list_head *head);
 
+/* Delete all nodes with a duplicated string from a queue in any order */
+bool q_delete_dup_unsorted(struct list_head *head);
+
+/* Seed the PRNG used by q_shuffle */
+void q_shuffle_seed(uint64_t seed);
+
+/*
+ * Sort engine used by q_sort
+ * (0: bottom-up, 1: top-down recursive, 2: natural runs, 3: MSD radix)
+ */
+extern int sort_engine;
+
+/* Number of threads q_sort may use */
+extern int sort_threads;
+
+/* Comparisons made by the last q_sort, by the engines counting them */
+extern size_t sort_compares;
+
+/* Whether q_delete_mid caches the middle node */
+extern int mid_cursor;
+
+#ifdef QUEUE_BACKEND
+/*
+ * Only the list backend has a sort engine, sort threads and a middle cursor.
+ * The backend built in, named by QUEUE_BACKEND, ignores them, so their
+ * options are defined here for qtest alone and warn when set.
+ */
+int sort_engine = 0;
+int sort_threads = 1;
+size_t sort_compares = 0;
+int mid_cursor = 1;
+#endif
+
 /* Global variables */
 
 /* List being tested */
@@ -67,6 +146,10 @@ static list_head_meta_t l_meta;
 /* Number of elements in queue */
 static size_t lcnt = 0;
 
+/* Queues set aside by chain, in order, for merge to merge into */
+static LIST_HEAD(chain);
+static int chain_cnt = 0;
+
 /* How many times can queue operations fail */
 static int fail_limit = BIG_LIST;
 static int fail_count = 0;
@@ -80,6 +163,23 @@ static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
 /* Forward declarations */
 static bool show_queue(int vlevel);
 
+/* Free the queues set aside by chain, with their contexts */
+static void free_chain()
+{
+    queue_context_t *ctx, *safe;
+    list_for_each_entry_safe (ctx, safe, &chain, chain) {
+        if (ctx->size > big_list_size)
+            set_cautious_mode(false);
+        if (exception_setup(true))
+            q_free(ctx->q);
+        exception_cancel();
+        set_cautious_mode(true);
+        list_del(&ctx->chain);
+        free(ctx);
+    }
+    chain_cnt = 0;
+}
+
 static bool do_free(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -102,6 +202,10 @@ static bool do_free(int argc, char *argv[])
     l_meta.size = 0;
     l_meta.l = NULL;
     lcnt = 0;
+    if (chain_cnt) {
+        report(3, "Freeing %d chained queues", chain_cnt);
+        free_chain();
+    }
     show_queue(3);
 
     size_t bcnt = allocation_check();
@@ -156,6 +260,101 @@ static void fill_rand_string(char *buf, size_t buf_size)
 }
 
 /* insert head */
+/* Strings inserted at once by the repeat form of ih and it */
+#define INSERT_BATCH 1024
+
+/*
+ * Insert reps strings at head or tail of the queue, INSERT_BATCH at a time
+ * with q_insert_head_bulk() or q_insert_tail_bulk(), for the repeat form of
+ * ih and it. Every string is a copy of inserts, or a new random one if
+ * need_rand is set.
+ */
+static bool insert_bulk(bool tail, char *inserts, bool need_rand, int reps)
+{
+    static char randstr[INSERT_BATCH][MAX_RANDSTR_LEN];
+    char *batch[INSERT_BATCH];
+    bool ok = true;
+
+    if (exception_setup(true)) {
+        for (int r = 0; ok && r < reps;) {
+            int n = reps - r < INSERT_BATCH ? reps - r : INSERT_BATCH;
+            for (int i = 0; i < n; i++) {
+                if (need_rand)
+                    fill_rand_string(randstr[i], sizeof(randstr[i]));
+                batch[i] = need_rand ? randstr[i] : inserts;
+            }
+            r += n;
+
+            bool rval = tail ? q_insert_tail_bulk(l_meta.l, batch, n)
+                             : q_insert_head_bulk(l_meta.l, batch, n);
+            if (rval) {
+                lcnt += n;
+                l_meta.size += n;
+                /* The last string of the batch ends up on the end it went to */
+                q_iter_t it;
+                char *cur_inserts = tail ? q_iter_last(l_meta.l, &it)
+                                         : q_iter_first(l_meta.l, &it);
+                char *next_inserts =
+                    tail || n < 2 ? NULL : q_iter_next(l_meta.l, &it);
+                if (!cur_inserts || strcmp(cur_inserts, batch[n - 1])) {
+                    report(1, "ERROR: Failed to save copy of string in queue");
+                    ok = false;
+                } else if (cur_inserts == batch[n - 1]) {
+                    report(1,
+                           "ERROR: Need to allocate and copy string for new "
+                           "queue element");
+                    ok = false;
+                } else if (next_inserts == cur_inserts && !intern_mode) {
+                    report(1,
+                           "ERROR: Need to allocate separate string for each "
+                           "queue element");
+                    ok = false;
+                }
+            } else {
+                fail_count++;
+                if (fail_count < fail_limit)
+                    report(2, "Insertion of %d strings failed", n);
+                else {
+                    report(1,
+                           "ERROR: Insertion of %d strings failed (%d failures "
+                           "total)",
+                           n, fail_count);
+                    ok = false;
+                }
+            }
+            ok = ok && !error_check();
+        }
+    }
+    exception_cancel();
+
+    show_queue(3);
+    return ok;
+}
+
+/*
+ * Insert string s at head or tail of the queue, as a copy or, in take mode,
+ * by handing over a block of the harness holding it. Store the block to
+ * *adopted, or NULL when the string is copied.
+ */
+static bool insert_one(bool tail, char *s, char **adopted)
+{
+    *adopted = NULL;
+    if (!take_mode)
+        return tail ? q_insert_tail(l_meta.l, s) : q_insert_head(l_meta.l, s);
+
+    char *buf = test_strdup(s);
+    if (!buf)
+        return false;
+    if (!(tail ? q_insert_tail_take(l_meta.l, buf)
+               : q_insert_head_take(l_meta.l, buf))) {
+        // The block still belongs to us when the insertion fails
+        test_free(buf);
+        return false;
+    }
+    *adopted = buf;
+    return true;
+}
+
 static bool do_ih(int argc, char *argv[])
 {
     if (simulation) {
@@ -198,19 +397,29 @@ static bool do_ih(int argc, char *argv[])
         report(3, "Warning: Calling insert head on null queue");
     error_check();
 
+    if (reps > 1 && !take_mode)
+        return insert_bulk(false, inserts, need_rand, reps);
+
     if (exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand)
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
-            bool rval = q_insert_head(l_meta.l, inserts);
+            char *adopted;
+            bool rval = insert_one(false, inserts, &adopted);
             if (rval) {
                 lcnt++;
                 l_meta.size++;
-                char *cur_inserts =
-                    list_entry(l_meta.l->next, element_t, list)->value;
+                q_iter_t it;
+                char *cur_inserts = q_iter_first(l_meta.l, &it);
                 if (!cur_inserts) {
                     report(1, "ERROR: Failed to save copy of string in queue");
                     ok = false;
+                } else if (adopted && adopted != cur_inserts) {
+                    report(1,
+                           "ERROR: Need to adopt the string handed over for "
+                           "new queue element");
+                    ok = false;
+                    break;
                 } else if (r == 0 && inserts == cur_inserts) {
                     report(1,
                            "ERROR: Need to allocate and copy string for new "
@@ -287,19 +496,28 @@ static bool do_it(int argc, char *argv[])
         report(3, "Warning: Calling insert tail on null queue");
     error_check();
 
+    if (reps > 1 && !take_mode)
+        return insert_bulk(true, inserts, need_rand, reps);
+
     if (exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand)
                 fill_rand_string(randstr_buf, sizeof(randstr_buf));
-            bool rval = q_insert_tail(l_meta.l, inserts);
+            char *adopted;
+            bool rval = insert_one(true, inserts, &adopted);
             if (rval) {
                 lcnt++;
                 l_meta.size++;
-                char *cur_inserts =
-                    list_entry(l_meta.l->prev, element_t, list)->value;
+                q_iter_t it;
+                char *cur_inserts = q_iter_last(l_meta.l, &it);
                 if (!cur_inserts) {
                     report(1, "ERROR: Failed to save copy of string in queue");
                     ok = false;
+                } else if (adopted && adopted != cur_inserts) {
+                    report(1,
+                           "ERROR: Need to adopt the string handed over for "
+                           "new queue element");
+                    ok = false;
                 }
             } else {
                 fail_count++;
@@ -380,17 +598,31 @@ static bool do_remove(int option, int argc, char *argv[])
     error_check();
 
     element_t *re = NULL;
-    if (exception_setup(true))
-        re = option ? q_remove_tail(l_meta.l, removes, string_length + 1)
-                    : q_remove_head(l_meta.l, removes, string_length + 1);
+    char *taken = NULL;
+    if (exception_setup(true)) {
+        if (take_mode)
+            taken = option ? q_remove_tail_take(l_meta.l)
+                           : q_remove_head_take(l_meta.l);
+        else
+            re = option ? q_remove_tail(l_meta.l, removes, string_length + 1)
+                        : q_remove_head(l_meta.l, removes, string_length + 1);
+    }
     exception_cancel();
 
-    bool is_null = re ? false : true;
+    bool is_null = re || taken ? false : true;
 
-    if (!is_null) {
+    if (taken) {
+        // The string handed back is ours to free
+        strncpy(removes, taken, string_length);
+        removes[string_length] = '\0';
+        test_free(taken);
+    } else if (re) {
         // q_remove_head and q_remove_tail are not responsible for releasing
         // node
         q_release_element(re);
+    }
+
+    if (!is_null) {
 
         removes[string_length + STRINGPAD] = '\0';
         if (removes[0] == '\0') {
@@ -450,13 +682,84 @@ static inline bool do_rt(int argc, char *argv[])
 }
 
 /* remove head quietly */
+/* Elements detached at once by the bulk-drain form of rhq */
+#define DRAIN_BATCH 1024
+
+/*
+ * Remove up to n elements from head of queue, DRAIN_BATCH at a time with
+ * q_remove_head_bulk(), and report the rate of the removals. Elements are
+ * released between batches, outside of the measured time.
+ */
+static bool drain_bulk(int n)
+{
+    static element_t *batch[DRAIN_BATCH];
+    double secs = 0;
+    int removed = 0;
+    bool ok = true;
+
+    if (!l_meta.l)
+        report(3, "Warning: Calling remove head on null queue");
+    error_check();
+
+    if (exception_setup(true)) {
+        while (ok && removed < n) {
+            int want = n - removed < DRAIN_BATCH ? n - removed : DRAIN_BATCH;
+            int expect = want < lcnt ? want : lcnt;
+            q_iter_t it;
+            char *first = l_meta.l ? q_iter_first(l_meta.l, &it) : NULL;
+
+            struct timespec start, end;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            int k = q_remove_head_bulk(l_meta.l, want, batch);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            secs += (end.tv_sec - start.tv_sec) +
+                    (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+            if (k != expect) {
+                report(1, "ERROR: Removed %d elements instead of %d", k,
+                       expect);
+                ok = false;
+                break;
+            }
+            if (k && batch[0]->value != first) {
+                report(1, "ERROR: Did not remove the elements at head");
+                ok = false;
+            }
+            // Removed elements are not released by q_remove_head_bulk
+            for (int i = 0; i < k; i++)
+                q_release_element(batch[i]);
+            removed += k;
+            lcnt -= k;
+            l_meta.size -= k;
+            if (k < want)
+                break;
+            ok = ok && !error_check();
+        }
+    }
+    exception_cancel();
+
+    report(1, "Removed %d elements, %.2f Melem/s", removed,
+           secs > 0 ? removed / secs / 1e6 : 0);
+    show_queue(3);
+    return ok && !error_check();
+}
+
 static bool do_rhq(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+    if (argc != 1 && argc != 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
         return false;
     }
 
+    if (argc == 2) {
+        int n;
+        if (!get_int(argv[1], &n) || n < 0) {
+            report(1, "Invalid number of removals '%s'", argv[1]);
+            return false;
+        }
+        return drain_bulk(n);
+    }
+
     bool ok = true;
     if (!l_meta.size)
         report(3, "Warning: Calling remove head on empty queue");
@@ -490,44 +793,344 @@ static bool do_rhq(int argc, char *argv[])
     return ok && !error_check();
 }
 
-static bool do_dedup(int argc, char *argv[])
+/* Buffer sizes the removals of rhcost are timed with */
+static const size_t rhcost_bufsizes[] = {16, 128, MAXSTRING + 1, 8192};
+#define NR_RHCOST_BUFSIZES \
+    (sizeof(rhcost_bufsizes) / sizeof(rhcost_bufsizes[0]))
+
+/*
+ * Time removals from head of queue copying the string out, once per buffer
+ * size of rhcost_bufsizes, and report the cost per removal. Up to n
+ * elements are removed in each round and inserted back at head afterwards,
+ * outside of the measured time, so the queue ends up as it was.
+ */
+static bool do_rhcost(int argc, char *argv[])
+{
+    static char buf[8192];
+    int n = INT_MAX;
+
+    if (argc > 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+    if (argc == 2 && (!get_int(argv[1], &n) || n < 1)) {
+        report(1, "Invalid number of removals '%s'", argv[1]);
+        return false;
+    }
+    if (!l_meta.l || !lcnt) {
+        report(1, "ERROR: Calling rhcost on null or empty queue");
+        return false;
+    }
+
+    int k = n < lcnt ? n : lcnt;
+    element_t **removed = malloc(k * sizeof(element_t *));
+    if (!removed) {
+        report(1, "INTERNAL ERROR.  Could not allocate space for elements");
+        return false;
+    }
+
+    bool ok = true;
+    for (size_t b = 0; ok && k && b < NR_RHCOST_BUFSIZES; b++) {
+        size_t bufsize = rhcost_bufsizes[b];
+        int got = 0;
+        struct timespec start, end;
+
+        if (exception_setup(true)) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (; got < k; got++) {
+                removed[got] = q_remove_head(l_meta.l, buf, bufsize);
+                if (!removed[got])
+                    break;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+        }
+        exception_cancel();
+
+        if (got < k) {
+            report(1, "ERROR: Removed %d elements instead of %d", got, k);
+            ok = false;
+        } else if (strncmp(buf, removed[k - 1]->value, bufsize - 1) ||
+                   strlen(buf) > bufsize - 1) {
+            report(1, "ERROR: Removed value %s != expected value %s", buf,
+                   removed[k - 1]->value);
+            ok = false;
+        } else {
+            double ns = (end.tv_sec - start.tv_sec) * 1e9 +
+                        (end.tv_nsec - start.tv_nsec);
+            report(1, "bufsize %5zu: %6.1f ns/remove", bufsize, ns / k);
+        }
+
+        // Put the elements back in order, as copies
+        int back = 0;
+        if (exception_setup(true)) {
+            for (; back < got; back++) {
+                element_t *e = removed[got - 1 - back];
+                if (!q_insert_head(l_meta.l, e->value))
+                    break;
+                q_release_element(e);
+            }
+        }
+        exception_cancel();
+        int dropped = got - back;
+        if (dropped) {
+            fail_count++;
+            if (fail_count < fail_limit)
+                report(2, "Could not insert back %d elements", dropped);
+            else {
+                report(1,
+                       "ERROR: Could not insert back %d elements (%d failures "
+                       "total)",
+                       dropped, fail_count);
+                ok = false;
+            }
+            for (; back < got; back++)
+                q_release_element(removed[got - 1 - back]);
+        }
+        lcnt -= dropped;
+        l_meta.size -= dropped;
+        ok = ok && !error_check();
+        // Later rounds remove what is left of the queue
+        if (k > lcnt)
+            k = lcnt;
+    }
+
+    free(removed);
+    show_queue(3);
+    return ok;
+}
+
+static bool do_intern(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    intern_stats_t stats;
+    intern_get_stats(&stats);
+    long saved = (long) stats.copy_bytes - (long) stats.table_bytes;
+    report(1,
+           "Interned %zu strings as %zu unique, %zu bytes of table, %ld bytes "
+           "saved",
+           stats.refs, stats.unique, stats.table_bytes, saved);
+    return true;
+}
+
+/*
+ * Add the number of elements of queue l and the bytes of their strings, NUL
+ * included, to *n and *str_bytes
+ */
+static void queue_bytes(struct list_head *l, size_t *n, size_t *str_bytes)
+{
+    q_iter_t it;
+    for (char *v = q_iter_first(l, &it); v; v = q_iter_next(l, &it)) {
+        (*n)++;
+        *str_bytes += strlen(v) + 1;
+    }
+}
+
+static bool do_mem(int argc, char *argv[])
 {
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
 
+    size_t n = 0, str_bytes = 0;
+    if (l_meta.l)
+        queue_bytes(l_meta.l, &n, &str_bytes);
+    queue_context_t *ctx;
+    list_for_each_entry (ctx, &chain, chain)
+        queue_bytes(ctx->q, &n, &str_bytes);
+
+    size_t bytes = allocation_bytes();
+    if (!n) {
+        report(1, "No element, %zu bytes allocated in %zu blocks", bytes,
+               allocation_check());
+        return true;
+    }
+    report(1,
+           "%zu elements in %zu bytes allocated in %zu blocks: %.1f bytes per "
+           "element, %.1f of them beyond the string",
+           n, bytes, allocation_check(), (double) bytes / n,
+           ((double) bytes - str_bytes) / n);
+    return true;
+}
+
+/* Count the elements of the queue under test by walking it */
+static int count_queue()
+{
+    q_iter_t it;
+    int n = 0;
+    for (char *v = q_iter_first(l_meta.l, &it); v;
+         v = q_iter_next(l_meta.l, &it))
+        n++;
+    return n;
+}
+
+/* Value of the queue under test and its position, for the dedup check */
+typedef struct {
+    char *value;
+    int pos;
+} dedup_entry_t;
+
+/*
+ * Largest queue checked against a snapshot after "dedup hash". The check
+ * sorts a copy of the queue, which would otherwise dominate the timing.
+ */
+#define DEDUP_CHECK_MAX 100000
+
+static int dedup_entry_cmp(const void *a, const void *b)
+{
+    return strcmp(((const dedup_entry_t *) a)->value,
+                  ((const dedup_entry_t *) b)->value);
+}
+
+/*
+ * Snapshot the queue before an order-preserving dedup: a copy of every
+ * value in queue order, flagged when it occurs only once. Return the number
+ * of values, or -1 if memory ran out.
+ */
+static int dedup_snapshot(dedup_entry_t **pentries, bool **punique)
+{
+    int n = count_queue();
+
+    dedup_entry_t *entries = calloc(n, sizeof(dedup_entry_t));
+    bool *unique = calloc(n, sizeof(bool));
+    if (!entries || !unique) {
+        free(entries);
+        free(unique);
+        return -1;
+    }
+
+    q_iter_t it;
+    int i = 0;
+    for (char *v = q_iter_first(l_meta.l, &it); v;
+         v = q_iter_next(l_meta.l, &it)) {
+        entries[i].value = v;
+        entries[i].pos = i;
+        i++;
+    }
+
+    /* Sort the entries by value to find every repeated one */
+    qsort(entries, n, sizeof(dedup_entry_t), dedup_entry_cmp);
+    for (int j = 0, k; j < n; j = k) {
+        for (k = j + 1; k < n && !dedup_entry_cmp(&entries[j], &entries[k]);
+             k++)
+            ;
+        unique[entries[j].pos] = k == j + 1;
+    }
+
+    /* Back to queue order, keeping copies of the values that survive */
+    for (int j = 0; j < n; j++) {
+        dedup_entry_t e = entries[j];
+        while (e.pos != j) {
+            dedup_entry_t next = entries[e.pos];
+            entries[e.pos] = e;
+            e = next;
+        }
+        entries[j] = e;
+    }
+    for (int j = 0; j < n; j++)
+        entries[j].value = unique[j] ? strdup(entries[j].value) : NULL;
+
+    *pentries = entries;
+    *punique = unique;
+    return n;
+}
+
+static bool do_dedup(int argc, char *argv[])
+{
+    bool hash = argc == 2 && !strcmp(argv[1], "hash");
+    if (argc != 1 && !hash) {
+        report(1, "%s takes no arguments or 'hash'", argv[0]);
+        return false;
+    }
+
+    dedup_entry_t *expect = NULL;
+    bool *unique = NULL;
+    int n = 0;
+    if (hash && l_meta.l && lcnt && lcnt <= DEDUP_CHECK_MAX) {
+        n = dedup_snapshot(&expect, &unique);
+        if (n < 0) {
+            report(1, "ERROR: Could not allocate memory to check dedup");
+            return false;
+        }
+    }
+
     bool ok = true;
+    error_check();
     // set_noallocate_mode(true);
     if (exception_setup(true))
-        ok = q_delete_dup(l_meta.l);
+        ok = hash ? q_delete_dup_unsorted(l_meta.l) : q_delete_dup(l_meta.l);
     exception_cancel();
 
     // set_noallocate_mode(false);
 
-    if (!ok) {
+    if (!ok && hash && l_meta.l && lcnt) {
+        /* The table could not be allocated, queue must be unchanged */
+        fail_count++;
+        if (fail_count < fail_limit) {
+            report(2, "Hash dedup failed");
+            ok = true;
+        } else {
+            report(1, "ERROR: Hash dedup failed (%d failures total)",
+                   fail_count);
+        }
+        for (int i = 0; i < n; i++)
+            unique[i] = true;
+    } else if (!ok) {
         report(1, "ERROR: Calling delete duplicate on null queue");
-        return false;
     }
 
-    element_t *item = NULL;
-    if (l_meta.size) {
-        list_for_each_entry (item, l_meta.l, list) {
-            element_t *next_item;
-            if (item->list.next == l_meta.l)
+    q_iter_t it;
+    char *item;
+    if (ok && hash && expect) {
+        int i = 0;
+        for (item = q_iter_first(l_meta.l, &it); item;
+             item = q_iter_next(l_meta.l, &it)) {
+            while (i < n && !unique[i])
+                i++;
+            if (i == n ||
+                (expect[i].value && strcmp(item, expect[i].value) != 0)) {
+                report(1, "ERROR: Not the remaining elements in their order");
+                ok = false;
                 break;
-            next_item = list_entry(item->list.next, element_t, list);
-
+            }
+            i++;
+        }
+        while (ok && i < n && !unique[i])
+            i++;
+        if (ok && i != n) {
+            report(1, "ERROR: Removed elements that were not duplicated");
+            ok = false;
+        }
+    } else if (ok && l_meta.size) {
+        char *next_item;
+        for (item = q_iter_first(l_meta.l, &it);
+             item && (next_item = q_iter_next(l_meta.l, &it));
+             item = next_item) {
             // assume queue has been sorted
-            if (strcmp(item->value, next_item->value) == 0) {
+            if (strcmp(item, next_item) == 0) {
                 report(1, "ERROR: Contain duplicate string on queue");
                 ok = false;
                 break;
             }
         }
     }
-    show_queue(3);
 
+    for (int i = 0; i < n; i++)
+        free(expect[i].value);
+    free(expect);
+    free(unique);
+
+    /* Recount what is left, so that size keeps checking q_size */
+    if (l_meta.l) {
+        lcnt = count_queue();
+        l_meta.size = lcnt;
+    }
+
+    show_queue(3);
     return ok && !error_check();
 }
 
@@ -617,22 +1220,39 @@ bool do_sort(int argc, char *argv[])
         report(3, "Warning: Calling sort on single node");
     error_check();
 
+    struct timespec start, end;
+    bool timed = false;
     set_noallocate_mode(true);
-    if (exception_setup(true))
+    if (exception_setup(true)) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
         q_sort(l_meta.l);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        timed = true;
+    }
     exception_cancel();
     set_noallocate_mode(false);
 
+    if (sort_stats && timed && cnt > 1) {
+        double ms = (end.tv_sec - start.tv_sec) * 1e3 +
+                    (end.tv_nsec - start.tv_nsec) / 1e6;
+        if (sort_compares)
+            report(1,
+                   "Sorted %d elements with %zu comparisons (%.3f n log2 n) "
+                   "in %.3f ms",
+                   cnt, sort_compares, sort_compares / (cnt * log2(cnt)), ms);
+        else
+            report(1, "Sorted %d elements in %.3f ms", cnt, ms);
+    }
+
     bool ok = true;
     if (l_meta.size) {
-        for (struct list_head *cur_l = l_meta.l->next;
-             cur_l != l_meta.l && --cnt; cur_l = cur_l->next) {
+        q_iter_t it;
+        char *item = q_iter_first(l_meta.l, &it), *next_item;
+        for (; --cnt > 0 && (next_item = q_iter_next(l_meta.l, &it));
+             item = next_item) {
             /* Ensure each element in ascending order */
             /* FIXME: add an option to specify sorting order */
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
-            if (strcasecmp(item->value, next_item->value) > 0) {
+            if (strcasecmp(item, next_item) > 0) {
                 report(1, "ERROR: Not sorted in ascending order");
                 ok = false;
                 break;
@@ -644,22 +1264,426 @@ bool do_sort(int argc, char *argv[])
     return ok && !error_check();
 }
 
-static bool do_dm(int argc, char *argv[])
+static bool do_chain(int argc, char *argv[])
 {
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
         return false;
     }
 
-    if (!l_meta.l)
-        report(3, "Warning: Try to access null queue");
+    if (!l_meta.l) {
+        report(3, "Warning: Calling chain on null queue");
+        return !error_check();
+    }
     error_check();
 
+    queue_context_t *ctx = malloc(sizeof(queue_context_t));
+    if (!ctx) {
+        report(1, "INTERNAL ERROR.  Could not allocate space for context");
+        return false;
+    }
+    struct list_head *l = NULL;
+    if (exception_setup(true))
+        l = q_new();
+    exception_cancel();
+    if (!l) {
+        report(3, "Warning: Could not start a new queue, nothing chained");
+        free(ctx);
+        return !error_check();
+    }
+
+    ctx->q = l_meta.l;
+    ctx->size = lcnt;
+    ctx->id = chain_cnt++;
+    list_add_tail(&ctx->chain, &chain);
+    l_meta.l = l;
+    l_meta.size = 0;
+    lcnt = 0;
+    show_queue(3);
+    return !error_check();
+}
+
+/* Whether queue l is in ascending order, as q_merge expects */
+static bool queue_sorted(struct list_head *l)
+{
+    q_iter_t it;
+    char *prev = q_iter_first(l, &it), *v;
+    for (; prev && (v = q_iter_next(l, &it)); prev = v) {
+        if (strcmp(prev, v) > 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Move the first n elements of queue l to the tail of queue to as fresh
+ * copies, laying them out in memory in queue order.
+ * Return false if could not allocate space, in which case elements have
+ * been lost.
+ */
+static bool requeue(struct list_head *l, struct list_head *to, int n)
+{
+    element_t *batch[64];
+    bool ok = true;
+    while (ok && n > 0) {
+        int k = q_remove_head_bulk(l, n < 64 ? n : 64, batch);
+        if (!k)
+            break;
+        int i = 0;
+        for (; i < k && (ok = q_insert_tail(to, batch[i]->value)); i++)
+            q_release_element(batch[i]);
+        for (; i < k; i++)
+            q_release_element(batch[i]);
+        n -= k;
+    }
+    return ok;
+}
+
+/*
+ * Merge the queues set aside by chain and the current one into the first
+ * of them, which becomes the current queue, and report the time taken.
+ * With "sort", time q_sort on all the elements gathered in the first queue
+ * instead, as a baseline. Either way, the elements are copied anew in queue
+ * order beforehand, without timing it, so that both are timed over the
+ * same layout in memory.
+ */
+static bool do_merge(int argc, char *argv[])
+{
+    bool sort = argc == 2 && !strcmp(argv[1], "sort");
+    if (argc > 2 || (argc == 2 && !sort)) {
+        report(1, "%s takes 0-1 arguments: [sort]", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.l) {
+        report(3, "Warning: Calling merge on null queue");
+        return !error_check();
+    }
+    error_check();
+
+    queue_context_t *cur = malloc(sizeof(queue_context_t));
+    if (!cur) {
+        report(1, "INTERNAL ERROR.  Could not allocate space for context");
+        return false;
+    }
+    cur->q = l_meta.l;
+    cur->size = lcnt;
+    cur->id = chain_cnt;
+    list_add_tail(&cur->chain, &chain);
+
+    // Merged order is only checked when every queue came in sorted
+    bool sorted = true;
+    size_t total = 0;
+    queue_context_t *ctx, *safe;
+    list_for_each_entry (ctx, &chain, chain) {
+        sorted = sorted && queue_sorted(ctx->q);
+        total += ctx->size;
+    }
+    if (!sorted && !sort)
+        report(3, "Warning: Merging queues not in ascending order");
+
+    queue_context_t *first = list_first_entry(&chain, queue_context_t, chain);
+    bool ok = true, copied = true;
+    int got = 0;
+    struct timespec start, end;
+
+    if (total > big_list_size)
+        set_cautious_mode(false);
+    if (exception_setup(true)) {
+        list_for_each_entry (ctx, &chain, chain) {
+            struct list_head *to = sort ? first->q : ctx->q;
+            copied = copied && requeue(ctx->q, to, ctx->size);
+        }
+    }
+    exception_cancel();
+    set_cautious_mode(true);
+
+    if (!copied) {
+        // Elements were dropped, the count cannot match any more
+        report(3, "Warning: Could not copy the elements to merge");
+    } else if (sort) {
+        set_noallocate_mode(true);
+        if (exception_setup(true)) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            q_sort(first->q);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+        }
+        exception_cancel();
+        set_noallocate_mode(false);
+        got = q_size(first->q);
+    } else {
+        if (total > big_list_size)
+            set_cautious_mode(false);
+        if (exception_setup(true)) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            got = q_merge(&chain);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+        }
+        exception_cancel();
+        set_cautious_mode(true);
+        if (got < 0) {
+            // Nothing moved: the current queue goes back to how it was
+            report(3, "Warning: Merge could not allocate space");
+            list_del(&cur->chain);
+            free(cur);
+            return !error_check();
+        }
+    }
+
+    if (copied && (size_t) got != total) {
+        report(1, "ERROR: Merged %d elements out of %zu", got, total);
+        ok = false;
+    } else if (copied && (sort || sorted) && !queue_sorted(first->q)) {
+        report(1, "ERROR: Not sorted in ascending order");
+        ok = false;
+    } else if (copied) {
+        double ms = (end.tv_sec - start.tv_sec) * 1e3 +
+                    (end.tv_nsec - start.tv_nsec) / 1e6;
+        report(1, "%s %zu elements of %d queues in %.3f ms",
+               sort ? "Sorted" : "Merged", total, chain_cnt + 1, ms);
+    }
+
+    // Whatever happened, the first queue carries on and the others go
+    l_meta.l = first->q;
+    list_del(&first->chain);
+    free(first);
+    list_for_each_entry_safe (ctx, safe, &chain, chain) {
+        if (exception_setup(true))
+            q_free(ctx->q);
+        exception_cancel();
+        list_del(&ctx->chain);
+        free(ctx);
+    }
+    chain_cnt = 0;
+    lcnt = count_queue();
+    l_meta.size = lcnt;
+
+    show_queue(3);
+    return ok && !error_check();
+}
+
+/*
+ * Largest queue checked by is, find and ds against a walk over all its
+ * elements, which would otherwise dominate the timing
+ */
+#define SORTED_CHECK_MAX 100000
+
+/* Whether queue l holds an element equal to s, found by walking it */
+static bool queue_has(struct list_head *l, const char *s)
+{
+    q_iter_t it;
+    for (char *v = q_iter_first(l, &it); v; v = q_iter_next(l, &it)) {
+        if (!strcmp(v, s))
+            return true;
+    }
+    return false;
+}
+
+static bool do_is(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3) {
+        report(1, "%s needs 1-2 arguments", argv[0]);
+        return false;
+    }
+
+    char randstr_buf[MAX_RANDSTR_LEN];
+    char *inserts = argv[1];
+    int reps = 1;
+    if (argc == 3 && !get_int(argv[2], &reps)) {
+        report(1, "Invalid number of insertions '%s'", argv[2]);
+        return false;
+    }
+    bool need_rand = !strcmp(inserts, "RAND");
+    if (need_rand)
+        inserts = randstr_buf;
+
+    if (!l_meta.l)
+        report(3, "Warning: Calling insert sorted on null queue");
+    error_check();
+
+    // In a queue out of order, inserts go anywhere and lookups may miss
+    bool in_order = lcnt > SORTED_CHECK_MAX || queue_sorted(l_meta.l);
     bool ok = true;
+    if (exception_setup(true)) {
+        for (int r = 0; ok && r < reps; r++) {
+            if (need_rand)
+                fill_rand_string(randstr_buf, sizeof(randstr_buf));
+            if (q_insert_sorted(l_meta.l, inserts)) {
+                lcnt++;
+                l_meta.size++;
+                char *found = q_find_sorted(l_meta.l, inserts);
+                if (in_order && (!found || strcmp(found, inserts))) {
+                    report(1, "ERROR: Could not find %s once inserted",
+                           inserts);
+                    ok = false;
+                }
+            } else {
+                fail_count++;
+                if (fail_count < fail_limit)
+                    report(2, "Insertion of %s failed", inserts);
+                else {
+                    report(1,
+                           "ERROR: Insertion of %s failed (%d failures total)",
+                           inserts, fail_count);
+                    ok = false;
+                }
+            }
+            ok = ok && !error_check();
+        }
+    }
+    exception_cancel();
+
+    if (ok && in_order && l_meta.l && lcnt <= SORTED_CHECK_MAX &&
+        !queue_sorted(l_meta.l)) {
+        report(1, "ERROR: Not sorted in ascending order");
+        ok = false;
+    }
+    show_queue(3);
+    return ok;
+}
+
+static bool do_find(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    if (!l_meta.l)
+        report(3, "Warning: Calling find on null queue");
+    error_check();
+
+    char *found = NULL;
     if (exception_setup(true))
-        ok = q_delete_mid(l_meta.l);
+        found = q_find_sorted(l_meta.l, argv[1]);
     exception_cancel();
 
+    bool ok = !error_check();
+    if (found && strcmp(found, argv[1])) {
+        report(1, "ERROR: Found %s looking for %s", found, argv[1]);
+        ok = false;
+    } else if (!found && l_meta.l && lcnt <= SORTED_CHECK_MAX &&
+               queue_sorted(l_meta.l) && queue_has(l_meta.l, argv[1])) {
+        report(1, "ERROR: Could not find %s in queue", argv[1]);
+        ok = false;
+    } else {
+        report(2, found ? "Found %s" : "%s not in queue", argv[1]);
+    }
+    return ok;
+}
+
+static bool do_ds(int argc, char *argv[])
+{
+    if (argc != 2 && argc != 3) {
+        report(1, "%s needs 1-2 arguments", argv[0]);
+        return false;
+    }
+
+    int reps = 1;
+    if (argc == 3 && !get_int(argv[2], &reps)) {
+        report(1, "Invalid number of deletions '%s'", argv[2]);
+        return false;
+    }
+
+    if (!l_meta.l)
+        report(3, "Warning: Calling delete sorted on null queue");
+    error_check();
+
+    bool ok = true, deleted = true;
+    int cnt = 0;
+    if (exception_setup(true)) {
+        for (int r = 0; deleted && r < reps; r++) {
+            deleted = q_delete_sorted(l_meta.l, argv[1]);
+            if (deleted)
+                cnt++;
+        }
+    }
+    exception_cancel();
+
+    lcnt -= cnt;
+    l_meta.size -= cnt;
+    ok = !error_check();
+    if (!deleted && l_meta.l && lcnt <= SORTED_CHECK_MAX &&
+        queue_sorted(l_meta.l) && queue_has(l_meta.l, argv[1])) {
+        report(1, "ERROR: Could not delete %s from queue", argv[1]);
+        ok = false;
+    } else if (q_size(l_meta.l) != lcnt) {
+        report(1, "ERROR: Deleted %d elements, but queue size is now %d", cnt,
+               q_size(l_meta.l));
+        ok = false;
+    } else {
+        report(2, "Deleted %d elements equal to %s", cnt, argv[1]);
+    }
+    show_queue(3);
+    return ok;
+}
+
+/*
+ * Largest queue on which dm checks the deleted node against a walk to the
+ * middle, which would otherwise dominate the timing of the cursor
+ */
+#define MID_CHECK_MAX 10000
+
+static bool do_dm(int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    int reps = 1;
+    if (argc == 2 && !get_int(argv[1], &reps)) {
+        report(1, "Invalid number of deletions '%s'", argv[1]);
+        return false;
+    }
+
+    if (!l_meta.l)
+        report(3, "Warning: Try to access null queue");
+    error_check();
+
+    bool ok = true;
+    for (int r = 0; ok && r < reps; r++) {
+        /*
+         * Values around index mid, to be found next to each other after
+         * dm. Strings are compared by address, which tells apart equal
+         * values of distinct elements.
+         */
+        size_t mid = lcnt / 2;
+        char *before = NULL, *after = NULL;
+        bool check = l_meta.l && lcnt && lcnt <= MID_CHECK_MAX;
+        if (check) {
+            q_iter_t it;
+            char *v = q_iter_first(l_meta.l, &it);
+            for (size_t i = 0; i < mid; i++) {
+                before = v;
+                v = q_iter_next(l_meta.l, &it);
+            }
+            after = q_iter_next(l_meta.l, &it);
+        }
+
+        if (exception_setup(true))
+            ok = q_delete_mid(l_meta.l);
+        exception_cancel();
+
+        if (ok && lcnt) {
+            lcnt--;
+            l_meta.size--;
+        }
+        if (ok && check) {
+            q_iter_t it;
+            char *v = q_iter_first(l_meta.l, &it), *prev = NULL;
+            for (size_t i = 0; i < mid; i++) {
+                prev = v;
+                v = q_iter_next(l_meta.l, &it);
+            }
+            if (prev != before || v != after) {
+                report(1, "ERROR: Did not delete the middle node");
+                ok = false;
+            }
+        }
+        ok = ok && !error_check();
+    }
+
     show_queue(3);
     return ok && !error_check();
 }
@@ -704,6 +1728,19 @@ static bool is_circular()
     return true;
 }
 
+static void shuffle_seed_set(int oldval)
+{
+    q_shuffle_seed(shuffle_seed);
+}
+
+/* Setter of the options only the list backend uses */
+static void list_option_set(int oldval)
+{
+#ifdef QUEUE_BACKEND
+    report(1, "Warning: Option ignored by the %s backend", QUEUE_BACKEND);
+#endif
+}
+
 static bool do_shuffle(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -728,6 +1765,435 @@ static bool do_shuffle(int argc, char *argv[])
     return !error_check();
 }
 
+/* Number of distinct strings cycled through by the spsc benchmark */
+#define SPSC_BENCH_POOL 64
+
+/* One side of the spsc benchmark, run on its own thread */
+typedef struct {
+    pthread_t tid;
+    bool producer;
+    long n;
+    /* Lock-free queue, or NULL for the mutex-guarded list */
+    spsc_t *ring;
+    struct list_head *l;
+    pthread_mutex_t *lock;
+    char **pool;
+    /* Strings received out of order, for the consumer */
+    long errors;
+    /* Cache misses counted on the thread, -1 if not available */
+    long long misses;
+} spsc_side_t;
+
+/*
+ * Open a counter of the cache misses of the calling thread in user space.
+ * Return its descriptor, or -1 if performance counters are not available.
+ */
+static int cache_miss_counter()
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void spsc_produce(spsc_side_t *side)
+{
+    for (long i = 0; i < side->n; i++) {
+        char *s = side->pool[i % SPSC_BENCH_POOL];
+        if (side->ring) {
+            while (!spsc_push(side->ring, s))
+                sched_yield();
+            continue;
+        }
+        // The list is unbounded: hold the producer back at the same depth
+        for (bool ok = false; !ok;) {
+            pthread_mutex_lock(side->lock);
+            ok = q_size(side->l) < spsc_capacity && q_insert_tail(side->l, s);
+            pthread_mutex_unlock(side->lock);
+            if (!ok)
+                sched_yield();
+        }
+    }
+    if (side->ring)
+        spsc_flush(side->ring);
+}
+
+static void spsc_consume(spsc_side_t *side)
+{
+    char buf[MAXSTRING];
+
+    for (long i = 0; i < side->n; i++) {
+        char *expect = side->pool[i % SPSC_BENCH_POOL];
+        if (side->ring) {
+            char *s;
+            while (!(s = spsc_pop(side->ring)))
+                sched_yield();
+            side->errors += s != expect;
+            continue;
+        }
+        for (element_t *e = NULL; !e;) {
+            pthread_mutex_lock(side->lock);
+            e = q_remove_head(side->l, buf, sizeof(buf));
+            if (e)
+                q_release_element(e);
+            pthread_mutex_unlock(side->lock);
+            if (!e)
+                sched_yield();
+        }
+        side->errors += strcmp(buf, expect) != 0;
+    }
+}
+
+static void *spsc_side_run(void *arg)
+{
+    spsc_side_t *side = arg;
+    int fd = cache_miss_counter();
+
+    if (fd >= 0)
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    if (side->producer)
+        spsc_produce(side);
+    else
+        spsc_consume(side);
+    side->misses = -1;
+    if (fd >= 0) {
+        long long count;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) == sizeof(count))
+            side->misses = count;
+        close(fd);
+    }
+    return NULL;
+}
+
+/*
+ * Pass n strings from a producer thread to a consumer thread, through the
+ * lock-free queue if ring is set, else through a queue of this backend
+ * guarded by a mutex, and report the throughput. Return false if the
+ * consumer did not receive the strings in order.
+ */
+static bool spsc_bench(const char *name, spsc_t *ring, struct list_head *l,
+                       long n, char **pool)
+{
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    spsc_side_t sides[2];
+    struct timespec start, end;
+
+    for (int i = 0; i < 2; i++) {
+        sides[i] = (spsc_side_t){.producer = i == 0,
+                                 .n = n,
+                                 .ring = ring,
+                                 .l = l,
+                                 .lock = &lock,
+                                 .pool = pool};
+    }
+
+    // A producer that cannot get its own thread runs on the caller
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (pthread_create(&sides[1].tid, NULL, spsc_side_run, &sides[1])) {
+        report(1, "ERROR: Could not start the %s consumer", name);
+        return false;
+    }
+    bool spawned =
+        !pthread_create(&sides[0].tid, NULL, spsc_side_run, &sides[0]);
+    if (!spawned)
+        spsc_side_run(&sides[0]);
+    if (spawned)
+        pthread_join(sides[0].tid, NULL);
+    pthread_join(sides[1].tid, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs =
+        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    report_noreturn(1, "%s: %ld strings, %.2f Mops/s, cache misses/op: ", name,
+                    n, n / secs / 1e6);
+    if (!n || sides[0].misses < 0 || sides[1].misses < 0)
+        report(1, "n/a");
+    else
+        report(1, "%.3f", (double) (sides[0].misses + sides[1].misses) / n);
+
+    if (sides[1].errors) {
+        report(1, "ERROR: %ld strings received out of order", sides[1].errors);
+        return false;
+    }
+    return true;
+}
+
+static bool do_spsc(int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    int n = SPSC_BENCH_N;
+    if (argc == 2 && (!get_int(argv[1], &n) || n < 0)) {
+        report(1, "Invalid number of strings '%s'", argv[1]);
+        return false;
+    }
+    if (spsc_capacity < 1 || spsc_batch < 1) {
+        report(1, "Invalid spsc capacity %d or batch %d", spsc_capacity,
+               spsc_batch);
+        return false;
+    }
+
+    char strs[SPSC_BENCH_POOL][8], *pool[SPSC_BENCH_POOL];
+    for (int i = 0; i < SPSC_BENCH_POOL; i++) {
+        snprintf(strs[i], sizeof(strs[i]), "s%d", i);
+        pool[i] = strs[i];
+    }
+
+    error_check();
+
+    /*
+     * Signals stay blocked while the threads run, so the harness time limit
+     * cannot unwind the stack under their feet, as in the parallel sort.
+     */
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+
+    bool ok = true;
+    spsc_t *ring = spsc_new(spsc_capacity, spsc_batch);
+    if (!ring) {
+        report(1, "ERROR: Could not allocate the spsc queue");
+        ok = false;
+    } else {
+        ok = spsc_bench("spsc", ring, NULL, n, pool);
+        spsc_free(ring);
+    }
+
+    struct list_head *l = q_new();
+    if (!l) {
+        report(1, "ERROR: Could not allocate the list");
+        ok = false;
+    } else {
+        ok = spsc_bench("list", NULL, l, n, pool) && ok;
+        q_free(l);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    return ok && !error_check();
+}
+
+/* Worker of the mpmc stress harness */
+typedef struct {
+    pthread_t tid;
+    mpmc_t *q;
+    /* Worker id enqueues items[id], items[id + nthreads], ... in order */
+    element_t **items;
+    long n;
+    int id, nthreads;
+    /* Per element index, the number of times it was dequeued */
+    atomic_int *seen;
+    /* Elements left to dequeue, over all workers */
+    atomic_long *remaining;
+    /* Dequeues that broke the order of a producer, or failed to allocate */
+    long errors;
+} mpmc_worker_t;
+
+/*
+ * Enqueue the elements of the worker while dequeuing, until every element
+ * of the run has been dequeued by some worker. Elements of one producer
+ * must come out in the order it enqueued them.
+ */
+static void *mpmc_worker_run(void *arg)
+{
+    mpmc_worker_t *w = arg;
+    mpmc_handle_t *h = mpmc_register(w->q);
+    long *last = malloc(w->nthreads * sizeof(long));
+
+    if (!h || !last) {
+        // The elements of this worker would never come: stop the run
+        free(last);
+        if (h)
+            mpmc_unregister(h);
+        w->errors++;
+        atomic_store(w->remaining, 0);
+        return NULL;
+    }
+    for (int p = 0; p < w->nthreads; p++)
+        last[p] = -1;
+
+    long next = w->id;
+    while (atomic_load_explicit(w->remaining, memory_order_relaxed) > 0) {
+        if (next < w->n) {
+            if (mpmc_enqueue(h, w->items[next]))
+                next += w->nthreads;
+            else
+                w->errors++;
+        }
+        element_t *e = mpmc_dequeue(h);
+        if (!e) {
+            if (next >= w->n)
+                sched_yield();
+            continue;
+        }
+        atomic_fetch_sub_explicit(w->remaining, 1, memory_order_relaxed);
+        long idx = strtol(e->value, NULL, 10);
+        atomic_fetch_add_explicit(&w->seen[idx], 1, memory_order_relaxed);
+        int p = idx % w->nthreads;
+        if (idx <= last[p])
+            w->errors++;
+        last[p] = idx;
+    }
+
+    free(last);
+    mpmc_unregister(h);
+    return NULL;
+}
+
+/*
+ * Pass the n elements of items through an mpmc queue with nthreads workers
+ * and report the throughput. Return false if an element was lost,
+ * duplicated or reordered.
+ */
+static bool mpmc_stress(element_t **items, long n, int nthreads,
+                        atomic_int *seen)
+{
+    mpmc_worker_t workers[MPMC_MAX_THREADS];
+    atomic_long remaining = n;
+    struct timespec start, end;
+    bool ok = true;
+
+    mpmc_t *q = mpmc_new(nthreads);
+    if (!q) {
+        report(1, "ERROR: Could not allocate the mpmc queue");
+        return false;
+    }
+    for (long i = 0; i < n; i++)
+        atomic_init(&seen[i], 0);
+
+    for (int i = 0; i < nthreads; i++) {
+        workers[i] = (mpmc_worker_t){.q = q,
+                                     .items = items,
+                                     .n = n,
+                                     .id = i,
+                                     .nthreads = nthreads,
+                                     .seen = seen,
+                                     .remaining = &remaining};
+    }
+
+    // Worker 0 runs on the caller
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int spawned = 1;
+    for (; spawned < nthreads; spawned++) {
+        if (pthread_create(&workers[spawned].tid, NULL, mpmc_worker_run,
+                           &workers[spawned]))
+            break;
+    }
+    if (spawned < nthreads) {
+        report(1, "ERROR: Could not start %d mpmc threads", nthreads);
+        atomic_store(&remaining, 0);
+        ok = false;
+    } else {
+        mpmc_worker_run(&workers[0]);
+    }
+    for (int i = 1; i < spawned; i++)
+        pthread_join(workers[i].tid, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    mpmc_free(q);
+
+    if (!ok)
+        return false;
+
+    double secs =
+        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    report(1, "mpmc: %d threads, %ld elements, %.2f Mops/s", nthreads, n,
+           secs > 0 ? n / secs / 1e6 : 0);
+
+    long errors = 0;
+    for (int i = 0; i < nthreads; i++)
+        errors += workers[i].errors;
+    if (errors) {
+        report(1, "ERROR: %ld elements dequeued out of order or not enqueued",
+               errors);
+        ok = false;
+    }
+    for (long i = 0; i < n; i++) {
+        if (atomic_load(&seen[i]) != 1) {
+            report(1, "ERROR: Element %ld dequeued %d times", i,
+                   atomic_load(&seen[i]));
+            ok = false;
+            break;
+        }
+    }
+    return ok;
+}
+
+static bool do_mpmc(int argc, char *argv[])
+{
+    if (argc != 1 && argc != 2) {
+        report(1, "%s takes 0-1 arguments", argv[0]);
+        return false;
+    }
+
+    int n = MPMC_BENCH_N;
+    if (argc == 2 && (!get_int(argv[1], &n) || n < 0)) {
+        report(1, "Invalid number of elements '%s'", argv[1]);
+        return false;
+    }
+
+    int max_threads = mpmc_threads;
+    if (max_threads <= 0)
+        max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 1)
+        max_threads = 1;
+    if (max_threads > MPMC_MAX_THREADS)
+        max_threads = MPMC_MAX_THREADS;
+
+    error_check();
+
+    /* Elements come from the queue under test, numbered by their value */
+    element_t **items = malloc((n ? n : 1) * sizeof(element_t *));
+    atomic_int *seen = malloc((n ? n : 1) * sizeof(atomic_int));
+    struct list_head *src = q_new();
+    bool ok = items && seen && src;
+    long made = 0;
+    while (ok && made < n) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%ld", made);
+        ok = q_insert_tail(src, buf);
+        if (ok)
+            items[made++] = q_remove_head(src, NULL, 0);
+    }
+    if (!ok)
+        report(1, "ERROR: Could not allocate the elements of mpmc");
+
+    /*
+     * Signals stay blocked while the threads run, so the harness time limit
+     * cannot unwind the stack under their feet, as in the parallel sort.
+     */
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+
+    // 1, 2, 4, ... threads, ending with max_threads
+    for (int t = 1; ok; t = 2 * t < max_threads ? 2 * t : max_threads) {
+        ok = mpmc_stress(items, n, t, seen);
+        if (t == max_threads)
+            break;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    // Every element has been dequeued exactly once, and is released here
+    if (made > big_list_size)
+        set_cautious_mode(false);
+    for (long i = 0; i < made; i++)
+        q_release_element(items[i]);
+    set_cautious_mode(true);
+    q_free(src);
+    free(items);
+    free(seen);
+    return ok && !error_check();
+}
+
 static bool show_queue(int vlevel)
 {
     bool ok = true;
@@ -747,16 +2213,15 @@ static bool show_queue(int vlevel)
 
     report_noreturn(vlevel, "l = [");
 
-    struct list_head *ori = l_meta.l;
-    struct list_head *cur = l_meta.l->next;
+    q_iter_t it;
+    char *cur = NULL;
 
     if (exception_setup(true)) {
-        while (ok && ori != cur && cnt < lcnt) {
-            element_t *e = list_entry(cur, element_t, list);
+        for (cur = q_iter_first(l_meta.l, &it); ok && cur && cnt < lcnt;
+             cur = q_iter_next(l_meta.l, &it)) {
             if (cnt < big_list_size)
-                report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", e->value);
+                report_noreturn(vlevel, cnt == 0 ? "%s" : " %s", cur);
             cnt++;
-            cur = cur->next;
             ok = ok && !error_check();
         }
     }
@@ -767,7 +2232,7 @@ static bool show_queue(int vlevel)
         return false;
     }
 
-    if (cur == ori) {
+    if (!cur) {
         if (cnt <= big_list_size)
             report(vlevel, "]");
         else
@@ -810,26 +2275,92 @@ static void console_init()
         rt,
         " [str]          | Remove from tail of queue.  Optionally compare "
         "to expected value str");
-    ADD_COMMAND(
-        rhq,
-        "                | Remove from head of queue without reporting value.");
+    ADD_COMMAND(rhq,
+                " [n]            | Remove from head of queue without reporting "
+                "value. With n, drain up to n elements in batches and report "
+                "the rate.");
+    ADD_COMMAND(rhcost,
+                " [n]            | Time removals of up to n elements from "
+                "head of queue into buffers of 16 to 8192 bytes, report the "
+                "cost per removal");
     ADD_COMMAND(reverse, "                | Reverse queue");
     ADD_COMMAND(sort, "                | Sort queue in ascending order");
+    ADD_COMMAND(chain,
+                "                | Set queue aside for merge and start a new "
+                "one");
+    ADD_COMMAND(merge,
+                " [sort]         | Merge the queues set aside by chain and the "
+                "current one, each sorted, into the first of them and report "
+                "the time (sort: time q_sort on them instead)");
+    ADD_COMMAND(is,
+                " str [n]        | Insert string str at its place in the "
+                "sorted queue n times. Generate random string(s) if str equals "
+                "RAND. (default: n == 1)");
+    ADD_COMMAND(find,
+                " str            | Look up string str in the sorted queue");
+    ADD_COMMAND(ds,
+                " str [n]        | Delete an element equal to str from the "
+                "sorted queue, n times or until none is left (default: n == "
+                "1)");
     ADD_COMMAND(
         size, " [n]            | Compute queue size n times (default: n == 1)");
     ADD_COMMAND(show, "                | Show queue contents");
-    ADD_COMMAND(dm, "                | Delete middle node in queue");
-    ADD_COMMAND(
-        dedup, "                | Delete all nodes that have duplicate string");
+    ADD_COMMAND(dm,
+                " [n]            | Delete middle node in queue n times "
+                "(default: n == 1)");
+    ADD_COMMAND(dedup,
+                " [hash]         | Delete all nodes that have duplicate string "
+                "(hash: also on unsorted queue)");
+    ADD_COMMAND(intern,
+                "                | Report strings shared through the "
+                "interning table and the memory saved");
+    ADD_COMMAND(mem,
+                "                | Report the bytes allocated by the queues "
+                "per element, in total and beyond the string itself");
     ADD_COMMAND(swap,
                 "                | Swap every two adjacent nodes in queue");
     ADD_COMMAND(shuffle, "                | Shuffle list randomly");
+    ADD_COMMAND(spsc,
+                " [n]            | Pass n strings between two threads through "
+                "the lock-free and the mutex-guarded queue, report Mops/s "
+                "(default: n == 1000000)");
+    ADD_COMMAND(mpmc,
+                " [n]            | Pass n elements through the lock-free "
+                "multi-producer/multi-consumer queue with 1, 2, 4, ... "
+                "threads, check none is lost (default: n == 100000)");
     add_param("length", &string_length, "Maximum length of displayed string",
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
               NULL);
     add_param("fail", &fail_limit,
               "Number of times allow queue operations to return false", NULL);
+    add_param("timelimit", &time_limit,
+              "Time limit in seconds for each queue operation", NULL);
+    add_param("sort", &sort_engine,
+              "Sort engine (0: bottom-up list_sort, 1: top-down, 2: natural "
+              "runs, 3: MSD radix)",
+              list_option_set);
+    add_param("threads", &sort_threads, "Number of threads used by sort",
+              list_option_set);
+    add_param("slab", &slab_mode,
+              "Element pool (0: malloc, 1: checked slabs, 2: fast slabs)",
+              NULL);
+    add_param("midcursor", &mid_cursor,
+              "Keep a cursor on the middle node for dm", list_option_set);
+    add_param("seed", &shuffle_seed, "Seed for shuffle", shuffle_seed_set);
+    add_param("intern", &intern_mode,
+              "Share the storage of equal strings of new elements", NULL);
+    add_param("sortstats", &sort_stats,
+              "Report comparisons made by sort and its time", NULL);
+    add_param("take", &take_mode,
+              "Hand strings over to the queue in ih/it and back in rh/rt",
+              NULL);
+    add_param("mpmcthreads", &mpmc_threads,
+              "Largest thread count of mpmc (0: number of cores)", NULL);
+    add_param("spsccap", &spsc_capacity, "Capacity of the queues of spsc",
+              NULL);
+    add_param("spscbatch", &spsc_batch,
+              "Strings published at once by the spsc queue", NULL);
 }
 
 /* Signal handlers */
@@ -867,6 +2398,7 @@ static bool queue_quit(int argc, char *argv[])
         q_free(l_meta.l);
     exception_cancel();
     set_cautious_mode(true);
+    free_chain();
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -0,0 +1,45 @@
+#ifndef LAB0_QUEUE_BULK_H
+#define LAB0_QUEUE_BULK_H
+
+/*
+ * Batch operations on a queue, provided by every backend next to the ones
+ * of queue.h.
+ *
+ * A batch of elements and their strings is allocated as a single block
+ * (see slab_arena_new), so loading a queue costs one allocation per batch
+ * rather than one per element. Elements are still released one by one with
+ * q_release_element(); the block goes back once all of its elements are
+ * gone. Draining a queue in batches detaches many elements per call, with
+ * no string copied out.
+ */
+
+#include <stdbool.h>
+
+#include "queue.h"
+
+/*
+ * Attempt to insert the n strings of s at head of queue, as n calls to
+ * q_insert_head() would: s[n - 1] ends up first.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space, in which case the
+ * queue is left unchanged.
+ */
+bool q_insert_head_bulk(struct list_head *head, char **s, int n);
+
+/*
+ * Attempt to insert the n strings of s at tail of queue, as n calls to
+ * q_insert_tail() would: s[n - 1] ends up last.
+ * Other attribute is as same as q_insert_head_bulk.
+ */
+bool q_insert_tail_bulk(struct list_head *head, char **s, int n);
+
+/*
+ * Attempt to remove up to n elements from head of queue at once, storing
+ * them to out[0], out[1], ... in queue order.
+ * Return the number of elements removed, 0 if q is NULL or empty.
+ * As with q_remove_head(), the elements are not freed: each of them is
+ * released with q_release_element(), and only its value field may be used.
+ */
+int q_remove_head_bulk(struct list_head *head, int n, element_t **out);
+
+#endif /* LAB0_QUEUE_BULK_H */
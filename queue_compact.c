@@ -0,0 +1,1175 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "harness.h"
+#include "intern.h"
+#include "loser_tree.h"
+#include "queue.h"
+#include "queue_bulk.h"
+#include "queue_iter.h"
+#include "queue_merge.h"
+#include "queue_sorted.h"
+#include "queue_take.h"
+#include "slab.h"
+
+/*
+ * Compact-list backend of the queue operations, built instead of queue.c
+ * with `make QUEUE=compact`.
+ *
+ * The queue is still a circular doubly-linked list, but its nodes live in a
+ * single array, the arena, and link to each other through 32-bit indices
+ * rather than pointers: 8 bytes of links per element instead of the 16 of a
+ * struct list_head. Node 0 is the sentinel standing for the head. Nothing in
+ * the arena points into it, so it grows by being copied elsewhere as is, and
+ * the same copy would snapshot the order of the queue. Removed nodes are
+ * chained into a free list through their next index and reused first.
+ *
+ * The list handed out by q_new() is only a handle and always stays empty.
+ * Elements are allocated as in the ring backend: value pointer and length
+ * followed by the string, or by a tag when the value lives elsewhere. The
+ * element_t returned by q_remove_head() and q_remove_tail() is only valid
+ * for its value field.
+ */
+
+/* Nodes in the arena of a new queue, sentinel included */
+#define COMPACT_MIN_CAP 16
+
+/* Largest arena, as every node must have a 32-bit index */
+#define COMPACT_MAX_CAP ((size_t) UINT32_MAX + 1)
+
+#define KEY_PREFIX_LEN sizeof(uint64_t)
+
+/* Tags left in str by an element whose value lives elsewhere */
+#define STR_ADOPTED '\0'
+#define STR_INTERNED '\1'
+
+/*
+ * Element as allocated by this backend, the leading part of element_t. len
+ * is the length of the string, copied out by removals without scanning it.
+ */
+typedef struct {
+    char *value;
+    size_t len;
+    char str[];
+} celem_t;
+
+/* Node of the arena: links by index and the element it holds */
+typedef struct {
+    uint32_t prev, next;
+    celem_t *e;
+} cnode_t;
+
+/*
+ * Queue descriptor, with the list head handed out by q_new() embedded at its
+ * start.
+ *
+ * Nodes below top have been handed out at some point: they are either
+ * linked from the sentinel node[0] or on the free list starting at
+ * free_node, 0 if empty. Nodes from top to cap - 1 were never used.
+ */
+typedef struct {
+    struct list_head head;
+    int size;
+    uint32_t free_node;
+    size_t top;
+    size_t cap;
+    cnode_t *node;
+} queue_t;
+
+/*
+ * Declaring a helper functions here given to the fact that queue.h is not
+ * allowed to be changed.
+ */
+
+/*
+ * Return the descriptor owning the given list head
+ */
+static inline queue_t *__q_of(struct list_head *head)
+{
+    return container_of(head, queue_t, head);
+}
+
+/*
+ * Pack the order-preserving key prefix of string s, as queue.c does
+ */
+static inline uint64_t __q_key(const char *s)
+{
+    uint64_t key = 0;
+    size_t i = 0;
+
+    for (; i < KEY_PREFIX_LEN && s[i]; i++)
+        key = (key << 8) | (unsigned char) s[i];
+    return key << (8 * (KEY_PREFIX_LEN - i));
+}
+
+/*
+ * Bytes of an element holding a string of length len, which is only stored
+ * in the element while interning is off
+ */
+static inline size_t __c_size(size_t len)
+{
+    return sizeof(celem_t) + (intern_mode ? 1 : len + 1);
+}
+
+/*
+ * Store string s of length len to element e, as a copy or, while intern_mode
+ * is set, as the shared copy of the interning table.
+ * Return false if could not allocate space.
+ */
+static bool __c_set(celem_t *e, const char *s, size_t len)
+{
+    if (intern_mode) {
+        e->value = intern_get(s, len);
+        if (!e->value)
+            return false;
+        e->str[0] = STR_INTERNED;
+    } else {
+        memcpy(e->str, s, len + 1);
+        e->value = e->str;
+    }
+    e->len = len;
+    return true;
+}
+
+/*
+ * Allocate an element holding string s
+ */
+static celem_t *__c_new(const char *s)
+{
+    size_t len = strlen(s);
+    celem_t *e = slab_alloc(__c_size(len));
+    if (!e)
+        return NULL;
+    if (!__c_set(e, s, len)) {
+        slab_free(e);
+        return NULL;
+    }
+    return e;
+}
+
+/*
+ * Return whether the value of e is a string of the interning table
+ */
+static inline bool __c_interned(celem_t *e)
+{
+    return e->value != e->str && e->str[0] == STR_INTERNED;
+}
+
+/*
+ * Return whether elements a and b have equal values. Two interned strings
+ * are equal only if they are the same string.
+ */
+static inline bool __c_same(celem_t *a, celem_t *b)
+{
+    if (a->value == b->value)
+        return true;
+    if (__c_interned(a) && __c_interned(b))
+        return false;
+    return !strcmp(a->value, b->value);
+}
+
+/*
+ * Allocate an element adopting string s as its value
+ */
+static celem_t *__c_adopt(char *s)
+{
+    celem_t *e = slab_alloc(sizeof(celem_t) + 1);
+    if (!e)
+        return NULL;
+    e->str[0] = STR_ADOPTED;
+    e->value = s;
+    e->len = strlen(s);
+    return e;
+}
+
+/*
+ * Release element e along with its string, wherever it lives
+ */
+static inline void __c_free(celem_t *e)
+{
+    if (__c_interned(e))
+        intern_put(e->value);
+    else if (e->value != e->str)
+        free(e->value);
+    slab_free(e);
+}
+
+/*
+ * Release element e that could not be linked, but not a string it adopted,
+ * which stays with the caller
+ */
+static inline void __c_drop(celem_t *e)
+{
+    if (__c_interned(e))
+        intern_put(e->value);
+    slab_free(e);
+}
+
+/*
+ * Make room in the arena for n more elements, doubling its capacity as many
+ * times as needed. The nodes in use are copied over unchanged.
+ * Return false if the larger arena could not be allocated.
+ */
+static bool __c_reserve(queue_t *q, size_t n)
+{
+    size_t cap = q->cap;
+    while (cap - 1 - q->size < n) {
+        if (cap == COMPACT_MAX_CAP)
+            return false;
+        cap *= 2;
+    }
+    if (cap == q->cap)
+        return true;
+
+    cnode_t *node = malloc(cap * sizeof(cnode_t));
+    if (!node)
+        return false;
+    memcpy(node, q->node, q->top * sizeof(cnode_t));
+    free(q->node);
+    q->node = node;
+    q->cap = cap;
+    return true;
+}
+
+/*
+ * Link e after node prev, in a node of the free list or else a never used
+ * one. Room must have been reserved.
+ */
+static void __c_link_after(queue_t *q, celem_t *e, uint32_t prev)
+{
+    cnode_t *node = q->node;
+    uint32_t i;
+    if (q->free_node) {
+        i = q->free_node;
+        q->free_node = node[i].next;
+    } else {
+        i = q->top++;
+    }
+
+    uint32_t next = node[prev].next;
+    node[i].prev = prev;
+    node[i].next = next;
+    node[i].e = e;
+    node[prev].next = i;
+    node[next].prev = i;
+    q->size++;
+}
+
+/*
+ * Link e at the start (front) or the end of the list
+ */
+static inline void __c_link(queue_t *q, celem_t *e, bool front)
+{
+    __c_link_after(q, e, front ? 0 : q->node[0].prev);
+}
+
+/*
+ * Unlink node i, putting it on the free list.
+ * Return its element.
+ */
+static inline celem_t *__c_unlink(queue_t *q, uint32_t i)
+{
+    cnode_t *node = q->node;
+    node[node[i].prev].next = node[i].next;
+    node[node[i].next].prev = node[i].prev;
+    node[i].next = q->free_node;
+    q->free_node = i;
+    q->size--;
+    return node[i].e;
+}
+
+/*
+ * Take the element at the start (front) or the end of the list
+ */
+static inline celem_t *__c_pop(queue_t *q, bool front)
+{
+    return __c_unlink(q, front ? q->node[0].next : q->node[0].prev);
+}
+
+/*
+ * Link nodes 1 to n of arena node one after the other, in that order, as
+ * the whole list
+ */
+static void __c_relink(cnode_t *node, size_t n)
+{
+    for (size_t i = 1; i <= n; i++) {
+        node[i].prev = i - 1;
+        node[i].next = i < n ? i + 1 : 0;
+    }
+    node[0].next = n ? 1 : 0;
+    node[0].prev = n;
+}
+
+/*
+ * Index of node x once nodes a and b have traded places
+ */
+static inline uint32_t __c_remap(uint32_t x, uint32_t a, uint32_t b)
+{
+    return x == a ? b : x == b ? a : x;
+}
+
+/*
+ * Move the nodes of the list into nodes 1 to size, in list order, and empty
+ * the free list. Nodes are swapped in place, fixing the links of their
+ * neighbours, so no memory is needed.
+ */
+static void __c_linearize(queue_t *q)
+{
+    cnode_t *node = q->node;
+    size_t n = q->size;
+
+    // Free nodes are told apart from linked ones by their NULL element
+    for (uint32_t i = q->free_node; i; i = node[i].next)
+        node[i].e = NULL;
+
+    uint32_t i = node[0].next;
+    for (uint32_t p = 1; p <= n; i = node[p++].next) {
+        if (i == p)
+            continue;
+        // Node i holds position p: swap it with whatever node p holds
+        bool used = node[p].e;
+        cnode_t tmp = node[i];
+        node[i] = node[p];
+        node[p] = tmp;
+
+        // Remap all the links first, as the two nodes may be neighbours
+        node[p].prev = __c_remap(node[p].prev, i, p);
+        node[p].next = __c_remap(node[p].next, i, p);
+        if (used) {
+            node[i].prev = __c_remap(node[i].prev, i, p);
+            node[i].next = __c_remap(node[i].next, i, p);
+        }
+        node[node[p].prev].next = p;
+        node[node[p].next].prev = p;
+        if (used) {
+            node[node[i].prev].next = i;
+            node[node[i].next].prev = i;
+        }
+    }
+    q->top = n + 1;
+    q->free_node = 0;
+}
+
+/*
+ * Hash a string: FNV-1a run through the splitmix64 finalizer
+ */
+static uint64_t __c_hash(const char *s)
+{
+    uint64_t h = 0xcbf29ce484222325;
+
+    for (; *s; s++)
+        h = (h ^ (unsigned char) *s) * 0x100000001b3;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+    return h ^ (h >> 31);
+}
+
+/*
+ * Create empty queue.
+ * Return NULL if could not allocate space.
+ */
+struct list_head *q_new()
+{
+    queue_t *q = malloc(sizeof(queue_t));
+    if (!q)
+        return NULL;
+    q->node = malloc(COMPACT_MIN_CAP * sizeof(cnode_t));
+    if (!q->node) {
+        free(q);
+        return NULL;
+    }
+    INIT_LIST_HEAD(&q->head);
+    q->size = 0;
+    q->free_node = 0;
+    q->top = 1;
+    q->cap = COMPACT_MIN_CAP;
+    __c_relink(q->node, 0);
+    return &q->head;
+}
+
+/* Free all storage used by queue */
+void q_free(struct list_head *l)
+{
+    if (!l)
+        return;
+    queue_t *q = __q_of(l);
+    for (uint32_t i = q->node[0].next; i; i = q->node[i].next)
+        __c_free(q->node[i].e);
+    free(q->node);
+    free(q);
+}
+
+/*
+ * Add element e at the start (front) or the end of the list. On failure e
+ * is released, but not a string it adopted.
+ * Return false if e is NULL or could not allocate space.
+ */
+static bool __c_add(queue_t *q, celem_t *e, bool front)
+{
+    if (!e)
+        return false;
+    if (!__c_reserve(q, 1)) {
+        __c_drop(e);
+        return false;
+    }
+    __c_link(q, e, front);
+    return true;
+}
+
+/*
+ * Attempt to insert element at head of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ * Argument s points to the string to be stored.
+ * The function must explicitly allocate space and copy the string into it.
+ */
+bool q_insert_head(struct list_head *head, char *s)
+{
+    if (!head)
+        return false;
+    return __c_add(__q_of(head), __c_new(s), true);
+}
+
+/*
+ * Attempt to insert element at tail of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ * Argument s points to the string to be stored.
+ * The function must explicitly allocate space and copy the string into it.
+ */
+bool q_insert_tail(struct list_head *head, char *s)
+{
+    if (!head)
+        return false;
+    return __c_add(__q_of(head), __c_new(s), false);
+}
+
+/*
+ * Attempt to insert element at head of queue adopting buffer s, see
+ * queue_take.h
+ */
+bool q_insert_head_take(struct list_head *head, char *s)
+{
+    if (!head || !s)
+        return false;
+    return __c_add(__q_of(head), __c_adopt(s), true);
+}
+
+/*
+ * Attempt to insert element at tail of queue adopting buffer s, see
+ * queue_take.h
+ */
+bool q_insert_tail_take(struct list_head *head, char *s)
+{
+    if (!head || !s)
+        return false;
+    return __c_add(__q_of(head), __c_adopt(s), false);
+}
+
+/*
+ * Insert the n strings of s one after the other at the start (front) or the
+ * end of the list, with room for their nodes reserved beforehand. Elements
+ * come from a single arena.
+ */
+static bool __c_link_bulk(queue_t *q, char **s, int n, bool front)
+{
+    if (!__c_reserve(q, n))
+        return false;
+    size_t bytes = 0;
+    for (int i = 0; i < n; i++)
+        bytes += slab_arena_size(__c_size(strlen(s[i])));
+    slab_arena_t *arena = slab_arena_new(bytes);
+    if (!arena)
+        return false;
+
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(s[i]);
+        celem_t *e = slab_arena_alloc(arena, __c_size(len));
+        if (!__c_set(e, s[i], len)) {
+            // Take the i elements linked so far off again; the arena goes
+            // back with the last of its elements
+            slab_free(e);
+            while (i--)
+                __c_free(__c_pop(q, front));
+            return false;
+        }
+        __c_link(q, e, front);
+    }
+    return true;
+}
+
+/*
+ * Attempt to insert the n strings of s at head of queue, see queue_bulk.h
+ */
+bool q_insert_head_bulk(struct list_head *head, char **s, int n)
+{
+    if (!head)
+        return false;
+    return n <= 0 || __c_link_bulk(__q_of(head), s, n, true);
+}
+
+/*
+ * Attempt to insert the n strings of s at tail of queue, see queue_bulk.h
+ */
+bool q_insert_tail_bulk(struct list_head *head, char **s, int n)
+{
+    if (!head)
+        return false;
+    return n <= 0 || __c_link_bulk(__q_of(head), s, n, false);
+}
+
+/*
+ * Copy the value of e to sp, up to bufsize - 1 characters. Only the string
+ * is written, not the rest of the buffer as strncpy would.
+ */
+static inline element_t *__c_out(celem_t *e, char *sp, size_t bufsize)
+{
+    if (sp && bufsize) {
+        size_t len = e->len < bufsize - 1 ? e->len : bufsize - 1;
+        memcpy(sp, e->value, len);
+        sp[len] = '\0';
+    }
+    return (element_t *) e;
+}
+
+/*
+ * Attempt to remove element from head of queue.
+ * Return target element, of which only the value field may be used.
+ * Return NULL if queue is NULL or empty.
+ * If sp is non-NULL and an element is removed, copy the removed string to *sp
+ * (up to a maximum of bufsize-1 characters, plus a null terminator.)
+ */
+element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
+{
+    if (!head || !__q_of(head)->size)
+        return NULL;
+    return __c_out(__c_pop(__q_of(head), true), sp, bufsize);
+}
+
+/*
+ * Attempt to remove element from tail of queue.
+ * Other attribute is as same as q_remove_head.
+ */
+element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
+{
+    if (!head || !__q_of(head)->size)
+        return NULL;
+    return __c_out(__c_pop(__q_of(head), false), sp, bufsize);
+}
+
+/*
+ * Attempt to remove up to n elements from head of queue, see queue_bulk.h
+ */
+int q_remove_head_bulk(struct list_head *head, int n, element_t **out)
+{
+    if (!head || n <= 0)
+        return 0;
+    queue_t *q = __q_of(head);
+    int k = 0;
+    for (; k < n && q->size; k++)
+        out[k] = (element_t *) __c_pop(q, true);
+    return k;
+}
+
+/*
+ * Remove the element at head or tail of queue and release it, returning its
+ * string as a block of its own. A string that was not adopted is duplicated
+ * first, so that failing to leaves the queue unchanged.
+ */
+static char *__c_take(struct list_head *head, bool tail)
+{
+    if (!head || !__q_of(head)->size)
+        return NULL;
+    queue_t *q = __q_of(head);
+    celem_t *e = q->node[tail ? q->node[0].prev : q->node[0].next].e;
+    char *s = e->value;
+    bool adopted = s != e->str && e->str[0] == STR_ADOPTED;
+    if (!adopted && !(s = strdup(s)))
+        return NULL;
+    __c_pop(q, !tail);
+    if (adopted)
+        slab_free(e);
+    else
+        __c_free(e);
+    return s;
+}
+
+/*
+ * Attempt to remove element from head of queue handing its string over, see
+ * queue_take.h
+ */
+char *q_remove_head_take(struct list_head *head)
+{
+    return __c_take(head, false);
+}
+
+/*
+ * Attempt to remove element from tail of queue handing its string over, see
+ * queue_take.h
+ */
+char *q_remove_tail_take(struct list_head *head)
+{
+    return __c_take(head, true);
+}
+
+/*
+ * WARN: This is for external usage, don't modify it
+ * Attempt to release element.
+ * The string lives in the same block as the value pointer (see __c_new),
+ * unless it was adopted (see __c_adopt).
+ */
+void q_release_element(element_t *e)
+{
+    __c_free((celem_t *) e);
+}
+
+/*
+ * Return number of elements in queue.
+ * Return 0 if q is NULL or empty
+ */
+int q_size(struct list_head *head)
+{
+    if (!head)
+        return 0;
+    return __q_of(head)->size;
+}
+
+/*
+ * Delete the middle node in list.
+ * The middle node of a linked list of size n is the
+ * ⌊n / 2⌋th node from the start using 0-based indexing.
+ * Return false if list is NULL or empty.
+ *
+ * The middle node is reached from the nearer end of the list.
+ */
+bool q_delete_mid(struct list_head *head)
+{
+    if (!head || !__q_of(head)->size)
+        return false;
+    queue_t *q = __q_of(head);
+    cnode_t *node = q->node;
+    size_t n = q->size, k = n / 2;
+    uint32_t i;
+
+    if (k < n - 1 - k) {
+        i = node[0].next;
+        while (k--)
+            i = node[i].next;
+    } else {
+        i = node[0].prev;
+        for (k = n - 1 - k; k; k--)
+            i = node[i].prev;
+    }
+    __c_free(__c_unlink(q, i));
+    return true;
+}
+
+/*
+ * Delete all nodes that have duplicate string,
+ * leaving only distinct strings from the original list.
+ * Return true if successful.
+ * Return false if list is NULL or empty.
+ *
+ * Note: this function always be called after sorting, in other words,
+ * list is guaranteed to be sorted in ascending order.
+ */
+bool q_delete_dup(struct list_head *head)
+{
+    if (!head || !__q_of(head)->size)
+        return false;
+    queue_t *q = __q_of(head);
+    cnode_t *node = q->node;
+
+    for (uint32_t i = node[0].next; i;) {
+        uint32_t j = node[i].next;
+        bool dup = false;
+        while (j && __c_same(node[i].e, node[j].e)) {
+            uint32_t next = node[j].next;
+            __c_free(__c_unlink(q, j));
+            j = next;
+            dup = true;
+        }
+        if (dup)
+            __c_free(__c_unlink(q, i));
+        i = j;
+    }
+    return true;
+}
+
+/* Slot of the hash table behind q_delete_dup_unsorted */
+typedef struct {
+    uint64_t hash;
+    /* Node of the first element seen with this value, 0 if empty */
+    uint32_t node;
+    bool dup;
+} __c_dedup_slot_t;
+
+/*
+ * Delete all nodes whose string occurs more than once, on a queue in any
+ * order, with the same open-addressing table as the list backend. Return
+ * false if queue is NULL or empty, or if the table could not be allocated,
+ * in which case the queue is left unchanged.
+ */
+bool q_delete_dup_unsorted(struct list_head *head)
+{
+    if (!head || !__q_of(head)->size)
+        return false;
+
+    queue_t *q = __q_of(head);
+    cnode_t *node = q->node;
+    size_t cap = 2;
+    while (cap < 2 * (size_t) q->size)
+        cap <<= 1;
+    __c_dedup_slot_t *table = malloc(cap * sizeof(__c_dedup_slot_t));
+    if (!table)
+        return false;
+    memset(table, 0, cap * sizeof(__c_dedup_slot_t));
+
+    for (uint32_t cur = node[0].next, next; cur; cur = next) {
+        next = node[cur].next;
+        uint64_t hash = __c_hash(node[cur].e->value);
+        size_t i = hash & (cap - 1);
+        while (table[i].node &&
+               (table[i].hash != hash || strcmp(node[table[i].node].e->value,
+                                                node[cur].e->value)))
+            i = (i + 1) & (cap - 1);
+
+        if (!table[i].node) {
+            table[i].hash = hash;
+            table[i].node = cur;
+            continue;
+        }
+        table[i].dup = true;
+        __c_free(__c_unlink(q, cur));
+    }
+
+    for (size_t i = 0; i < cap; i++) {
+        if (table[i].dup)
+            __c_free(__c_unlink(q, table[i].node));
+    }
+
+    free(table);
+    return true;
+}
+
+/*
+ * Attempt to swap every two adjacent nodes.
+ * The elements are swapped, the links stay.
+ */
+void q_swap(struct list_head *head)
+{
+    if (!head)
+        return;
+    cnode_t *node = __q_of(head)->node;
+    for (uint32_t a = node[0].next; a && node[a].next; a = node[a].next) {
+        uint32_t b = node[a].next;
+        celem_t *tmp = node[a].e;
+        node[a].e = node[b].e;
+        node[b].e = tmp;
+        a = b;
+    }
+}
+
+/*
+ * Reverse elements in queue
+ * No effect if q is NULL or empty
+ * The two links of every linked node, sentinel included, are exchanged.
+ */
+void q_reverse(struct list_head *head)
+{
+    if (!head)
+        return;
+    cnode_t *node = __q_of(head)->node;
+    uint32_t i = 0;
+    do {
+        uint32_t next = node[i].next;
+        node[i].next = node[i].prev;
+        node[i].prev = next;
+        i = next;
+    } while (i);
+}
+
+/* Element and its key prefix, as sorted by q_sort */
+typedef struct {
+    uint64_t key;
+    celem_t *e;
+} __c_item_t;
+
+/* Runs sorted by insertion before merging */
+#define SORT_RUN 16
+
+static inline int __c_cmp(const __c_item_t *a, const __c_item_t *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    // Equal keys with a zero last byte mean both strings ended early
+    if (!(a->key & 0xff))
+        return 0;
+    return strcmp(a->e->value + KEY_PREFIX_LEN, b->e->value + KEY_PREFIX_LEN);
+}
+
+/*
+ * Sort elements of queue in ascending order
+ * No effect if q is NULL or empty. In addition, if q has only one
+ * element, do nothing.
+ *
+ * The elements and their key prefixes are gathered into an array mapped
+ * from the kernel (qtest sorts in no-allocate mode) and sorted there with a
+ * stable bottom-up merge sort, as in the ring backend. They are then laid
+ * out in nodes 1 to size of the arena, in order, which also empties the
+ * free list. Nothing happens if the array cannot be mapped.
+ */
+void q_sort(struct list_head *head)
+{
+    if (!head)
+        return;
+    queue_t *q = __q_of(head);
+    size_t n = q->size;
+    if (n < 2)
+        return;
+
+    size_t bytes = 2 * n * sizeof(__c_item_t);
+    __c_item_t *src = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (src == MAP_FAILED)
+        return;
+    __c_item_t *dst = src + n, *buf = src;
+
+    uint32_t node = q->node[0].next;
+    for (size_t i = 0; i < n; i++, node = q->node[node].next) {
+        src[i].e = q->node[node].e;
+        src[i].key = __q_key(src[i].e->value);
+    }
+
+    for (size_t lo = 0; lo < n; lo += SORT_RUN) {
+        size_t hi = lo + SORT_RUN < n ? lo + SORT_RUN : n;
+        for (size_t i = lo + 1; i < hi; i++) {
+            __c_item_t x = src[i];
+            size_t j = i;
+            for (; j > lo && __c_cmp(&x, &src[j - 1]) < 0; j--)
+                src[j] = src[j - 1];
+            src[j] = x;
+        }
+    }
+
+    for (size_t width = SORT_RUN; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi)
+                dst[k++] = __c_cmp(&src[j], &src[i]) < 0 ? src[j++] : src[i++];
+            while (i < mid)
+                dst[k++] = src[i++];
+            while (j < hi)
+                dst[k++] = src[j++];
+        }
+        __c_item_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    for (size_t i = 0; i < n; i++)
+        q->node[i + 1].e = src[i].e;
+    __c_relink(q->node, n);
+    q->top = n + 1;
+    q->free_node = 0;
+
+    munmap(buf, bytes);
+}
+
+/*
+ * Read position of a queue taking part in a merge, with the next element
+ * and its key prefix at hand for the matches of the loser tree. The
+ * position is a node index, 0 once the queue is exhausted.
+ */
+typedef struct {
+    queue_t *q;
+    uint32_t i;
+    __c_item_t next;
+} __c_cursor_t;
+
+/*
+ * Load the element at the position of cursor c, if any
+ */
+static inline void __c_cursor_load(__c_cursor_t *c)
+{
+    if (!c->i)
+        return;
+    c->next.e = c->q->node[c->i].e;
+    c->next.key = __q_key(c->next.e->value);
+}
+
+/*
+ * Whether the next element of cursor a goes before the one of cursor b in
+ * a merge, ties going to the earlier queue. Exhausted cursors lose.
+ */
+static bool __c_merge_beats(void *ctx, int a, int b)
+{
+    __c_cursor_t *cur = ctx;
+    if (!cur[a].i)
+        return false;
+    if (!cur[b].i)
+        return true;
+    int cmp = __c_cmp(&cur[a].next, &cur[b].next);
+    return cmp < 0 || (cmp == 0 && a < b);
+}
+
+/*
+ * Merge sorted queues into the first one, see queue_merge.h, past
+ * LOSER_TREE_MAX queues in O(N k / LOSER_TREE_MAX) as stated there. The
+ * first queue and up to LOSER_TREE_MAX - 1 others are merged at each pass, into
+ * an arena large enough for all the elements, laid out in order, which
+ * then becomes the arena of the first queue. With more than one pass, two
+ * such arenas take turns, both allocated before anything moves. The other
+ * queues keep their arena, emptied.
+ */
+int q_merge(struct list_head *head)
+{
+    if (!head || list_empty(head))
+        return 0;
+
+    queue_context_t *first = list_first_entry(head, queue_context_t, chain);
+    if (!first->q)
+        return 0;
+    queue_t *fq = __q_of(first->q);
+
+    size_t total = 0;
+    int others = 0;
+    queue_context_t *ctx;
+    list_for_each_entry (ctx, head, chain) {
+        if (ctx->q && ctx != first && __q_of(ctx->q)->size) {
+            total += __q_of(ctx->q)->size;
+            others++;
+        }
+    }
+    if (!others) {
+        first->size = fq->size;
+        return first->size;
+    }
+    total += fq->size;
+
+    size_t cap = COMPACT_MIN_CAP;
+    while (cap < total + 1)
+        cap <<= 1;
+    if (cap > COMPACT_MAX_CAP)
+        return -1;
+    cnode_t *buf[2] = {NULL, NULL};
+    int nbuf = others > LOSER_TREE_MAX - 1 ? 2 : 1;
+    for (int b = 0; b < nbuf; b++) {
+        buf[b] = malloc(cap * sizeof(cnode_t));
+        if (!buf[b]) {
+            free(buf[0]);
+            return -1;
+        }
+    }
+
+    __c_cursor_t cur[LOSER_TREE_MAX];
+    int tree[LOSER_TREE_MAX];
+    struct list_head *pos = first->chain.next;
+    for (int pass = 0; pos != head; pass++) {
+        int k = 0;
+        cur[k++].q = fq;
+        for (; pos != head && k < LOSER_TREE_MAX; pos = pos->next) {
+            ctx = list_entry(pos, queue_context_t, chain);
+            if (ctx->q && __q_of(ctx->q)->size)
+                cur[k++].q = __q_of(ctx->q);
+            ctx->size = 0;
+        }
+        for (int i = 0; i < k; i++) {
+            cur[i].i = cur[i].q->node[0].next;
+            __c_cursor_load(&cur[i]);
+        }
+
+        cnode_t *out = buf[pass & 1];
+        size_t n = 0;
+        loser_tree_build(tree, k, __c_merge_beats, cur);
+        while (cur[tree[0]].i) {
+            int w = tree[0];
+            out[++n].e = cur[w].next.e;
+            cur[w].i = cur[w].q->node[cur[w].i].next;
+            __c_cursor_load(&cur[w]);
+            loser_tree_replay(tree, k, w, __c_merge_beats, cur);
+        }
+        __c_relink(out, n);
+
+        for (int i = 1; i < k; i++) {
+            cur[i].q->size = 0;
+            cur[i].q->free_node = 0;
+            cur[i].q->top = 1;
+            __c_relink(cur[i].q->node, 0);
+        }
+        if (fq->node != buf[0] && fq->node != buf[1])
+            free(fq->node);
+        fq->node = out;
+        fq->cap = cap;
+        fq->top = n + 1;
+        fq->free_node = 0;
+        fq->size = n;
+    }
+
+    if (nbuf == 2)
+        free(fq->node == buf[0] ? buf[1] : buf[0]);
+    first->size = fq->size;
+    return first->size;
+}
+
+/*
+ * Return the node of the first element after string s, or not before it
+ * unless after is set, walking the list from its start. Return the sentinel
+ * if there is none.
+ */
+static uint32_t __c_seek(queue_t *q, const char *s, bool after)
+{
+    cnode_t *node = q->node;
+    uint32_t i = node[0].next;
+    for (; i; i = node[i].next) {
+        int cmp = strcmp(node[i].e->value, s);
+        if (cmp > 0 || (!after && cmp == 0))
+            break;
+    }
+    return i;
+}
+
+/*
+ * Attempt to insert a copy of s at its place in the queue, see
+ * queue_sorted.h. The place is found by walking the list, as the nodes
+ * have no order in the arena to search.
+ */
+bool q_insert_sorted(struct list_head *head, char *s)
+{
+    if (!head)
+        return false;
+    queue_t *q = __q_of(head);
+    celem_t *e = __c_new(s);
+    if (!e)
+        return false;
+    if (!__c_reserve(q, 1)) {
+        __c_free(e);
+        return false;
+    }
+    __c_link_after(q, e, q->node[__c_seek(q, s, true)].prev);
+    return true;
+}
+
+/*
+ * Look up an element equal to s by walking the list, see queue_sorted.h
+ */
+char *q_find_sorted(struct list_head *head, const char *s)
+{
+    if (!head)
+        return NULL;
+    queue_t *q = __q_of(head);
+    uint32_t i = __c_seek(q, s, false);
+    if (!i || strcmp(q->node[i].e->value, s))
+        return NULL;
+    return q->node[i].e->value;
+}
+
+/*
+ * Delete the first element equal to s, found by walking the list, see
+ * queue_sorted.h
+ */
+bool q_delete_sorted(struct list_head *head, const char *s)
+{
+    if (!head)
+        return false;
+    queue_t *q = __q_of(head);
+    uint32_t i = __c_seek(q, s, false);
+    if (!i || strcmp(q->node[i].e->value, s))
+        return false;
+    __c_free(__c_unlink(q, i));
+    return true;
+}
+
+/* State of the splitmix64 generator behind q_shuffle, 0 until seeded */
+static uint64_t shuffle_state = 0;
+
+/*
+ * Seed the shuffle PRNG, making q_shuffle reproducible
+ */
+void q_shuffle_seed(uint64_t seed)
+{
+    shuffle_state = seed ? seed : 1;
+}
+
+/*
+ * splitmix64, as in queue.c
+ */
+static uint64_t __q_rand()
+{
+    uint64_t z = (shuffle_state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Unbiased random integer in [0, bound), as in queue.c
+ */
+static uint64_t __q_rand_below(uint64_t bound)
+{
+    __uint128_t m = (__uint128_t) __q_rand() * bound;
+    uint64_t low = (uint64_t) m;
+    if (low < bound) {
+        uint64_t threshold = -bound % bound;
+        while (low < threshold) {
+            m = (__uint128_t) __q_rand() * bound;
+            low = (uint64_t) m;
+        }
+    }
+    return m >> 64;
+}
+
+/*
+ * Fisher–Yates shuffle of the elements over nodes 1 to size, once the list
+ * has been laid out there in order
+ */
+void q_shuffle(struct list_head *head)
+{
+    if (!head)
+        return;
+    queue_t *q = __q_of(head);
+    if (q->size < 2)
+        return;
+
+    if (!shuffle_state)
+        q_shuffle_seed(((uint64_t) rand() << 32) ^ rand());
+    __c_linearize(q);
+    for (size_t i = q->size; i > 1; i--) {
+        cnode_t *a = &q->node[i], *b = &q->node[1 + __q_rand_below(i)];
+        celem_t *tmp = a->e;
+        a->e = b->e;
+        b->e = tmp;
+    }
+}
+
+/*
+ * Cursor over queue elements, see queue_iter.h. The cursor is a node index.
+ */
+char *q_iter_first(struct list_head *head, q_iter_t *it)
+{
+    if (!head)
+        return NULL;
+    it->idx = 0;
+    return q_iter_next(head, it);
+}
+
+char *q_iter_last(struct list_head *head, q_iter_t *it)
+{
+    if (!head || !__q_of(head)->size)
+        return NULL;
+    cnode_t *node = __q_of(head)->node;
+    it->idx = node[0].prev;
+    return node[it->idx].e->value;
+}
+
+char *q_iter_next(struct list_head *head, q_iter_t *it)
+{
+    cnode_t *node = __q_of(head)->node;
+    it->idx = node[(uint32_t) it->idx].next;
+    return it->idx ? node[(uint32_t) it->idx].e->value : NULL;
+}
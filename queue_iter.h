@@ -0,0 +1,47 @@
+#ifndef LAB0_QUEUE_ITER_H
+#define LAB0_QUEUE_ITER_H
+
+/*
+ * Read-only traversal of a queue, whatever backend stores its elements.
+ *
+ * The list handed out by q_new() links elements directly in the default
+ * backend, but links blocks of elements, or nothing at all, in others (see
+ * Makefile, QUEUE=...), so code outside the backend walks a queue through a
+ * cursor:
+ *
+ *     q_iter_t it;
+ *     for (char *v = q_iter_first(head, &it); v; v = q_iter_next(head, &it))
+ *         ...
+ *
+ * The queue must not be modified while a cursor is in use.
+ */
+
+#include "list.h"
+
+/* Position of a cursor within a queue */
+typedef struct {
+    /* Current list node: an element, a block of elements, or unused */
+    struct list_head *node;
+    /* Slot within the block, or index within an array-backed queue */
+    int idx;
+} q_iter_t;
+
+/*
+ * Move the cursor to the first element of the queue.
+ * Return its value, or NULL if q is NULL or empty.
+ */
+char *q_iter_first(struct list_head *head, q_iter_t *it);
+
+/*
+ * Move the cursor to the last element of the queue.
+ * Return its value, or NULL if q is NULL or empty.
+ */
+char *q_iter_last(struct list_head *head, q_iter_t *it);
+
+/*
+ * Move the cursor to the next element.
+ * Return its value, or NULL once past the last element.
+ */
+char *q_iter_next(struct list_head *head, q_iter_t *it);
+
+#endif /* LAB0_QUEUE_ITER_H */
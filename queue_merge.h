@@ -0,0 +1,41 @@
+#ifndef LAB0_QUEUE_MERGE_H
+#define LAB0_QUEUE_MERGE_H
+
+/*
+ * Merge of many sorted queues at once, provided by every backend next to
+ * the operations of queue.h.
+ *
+ * Splicing k sorted queues together and sorting the result again costs
+ * O(N log N) comparisons; q_merge() plays the heads of the queues against
+ * each other in a loser tree (see loser_tree.h) and costs O(N log k).
+ *
+ * A loser tree takes up to LOSER_TREE_MAX queues. Past that, the list
+ * backend merges them in groups, then the results in groups, and so on, so
+ * that the bound holds. The other backends instead merge the first queue
+ * with each next group of LOSER_TREE_MAX - 1 in turn, reading the elements
+ * merged so far again every time: O(N k / LOSER_TREE_MAX) for more queues.
+ */
+
+#include "list.h"
+
+/* Queue taking part in q_merge(), linked to the others through chain */
+typedef struct {
+    struct list_head *q;
+    struct list_head chain;
+    int size;
+    int id;
+} queue_context_t;
+
+/*
+ * Merge the queues of all contexts on the list head, each sorted in
+ * ascending order, into the queue of the first context, leaving the other
+ * queues empty. The size fields of the contexts are updated.
+ * Return the number of elements in the merged queue, 0 if head is NULL or
+ * empty.
+ * Return -1 if could not allocate space, in which case every queue is left
+ * unchanged. The list backend relinks the elements and never allocates;
+ * the others build the storage of the merged queue anew.
+ */
+int q_merge(struct list_head *head);
+
+#endif /* LAB0_QUEUE_MERGE_H */
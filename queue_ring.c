@@ -0,0 +1,1116 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "harness.h"
+#include "intern.h"
+#include "loser_tree.h"
+#include "queue.h"
+#include "queue_bulk.h"
+#include "queue_iter.h"
+#include "queue_merge.h"
+#include "queue_sorted.h"
+#include "queue_take.h"
+#include "slab.h"
+
+/*
+ * Ring-buffer backend of the queue operations, built instead of queue.c
+ * with `make QUEUE=ring`.
+ *
+ * Element pointers live in a circular array whose capacity is a power of
+ * two and doubles whenever it is full, so inserts and removes on either end
+ * touch a single slot. The list handed out by q_new() is only a handle and
+ * always stays empty. Reversing the queue flips the direction in which the
+ * array is read, and sort runs on a flat array of the elements.
+ *
+ * An element is allocated as its value pointer and length followed by the
+ * string, or by a tag when its value lives elsewhere: adopted (see
+ * queue_take.h) or interned (see intern.h). The element_t returned by
+ * q_remove_head() and q_remove_tail() is only valid for its value field: the
+ * list links are not part of the allocation.
+ */
+
+/* Capacity of the array of a new queue */
+#define RING_MIN_CAP 16
+
+#define KEY_PREFIX_LEN sizeof(uint64_t)
+
+/* Tags left in str by an element whose value lives elsewhere */
+#define STR_ADOPTED '\0'
+#define STR_INTERNED '\1'
+
+/*
+ * Element as allocated by this backend, the leading part of element_t. len
+ * is the length of the string, copied out by removals without scanning it.
+ */
+typedef struct {
+    char *value;
+    size_t len;
+    char str[];
+} relem_t;
+
+/*
+ * Queue descriptor, with the list head handed out by q_new() embedded at its
+ * start.
+ *
+ * The elements sit in ring[first], ring[first + 1], ... ring[first + size -
+ * 1], indices taken modulo cap. They are in queue order, or in reverse
+ * order when reversed is set.
+ */
+typedef struct {
+    struct list_head head;
+    int size;
+    bool reversed;
+    size_t cap;
+    size_t first;
+    relem_t **ring;
+} queue_t;
+
+/*
+ * Declaring a helper functions here given to the fact that queue.h is not
+ * allowed to be changed.
+ */
+
+/*
+ * Return the descriptor owning the given list head
+ */
+static inline queue_t *__q_of(struct list_head *head)
+{
+    return container_of(head, queue_t, head);
+}
+
+/*
+ * Return the slot at offset k from the first one in the array
+ */
+static inline relem_t **__r_phys(queue_t *q, size_t k)
+{
+    return &q->ring[(q->first + k) & (q->cap - 1)];
+}
+
+/*
+ * Return the slot of the element at index i in queue order
+ */
+static inline relem_t **__r_at(queue_t *q, size_t i)
+{
+    return __r_phys(q, q->reversed ? q->size - 1 - i : i);
+}
+
+/*
+ * Pack the order-preserving key prefix of string s, as queue.c does
+ */
+static inline uint64_t __q_key(const char *s)
+{
+    uint64_t key = 0;
+    size_t i = 0;
+
+    for (; i < KEY_PREFIX_LEN && s[i]; i++)
+        key = (key << 8) | (unsigned char) s[i];
+    return key << (8 * (KEY_PREFIX_LEN - i));
+}
+
+/*
+ * Bytes of an element holding a string of length len, which is only stored
+ * in the element while interning is off
+ */
+static inline size_t __r_size(size_t len)
+{
+    return sizeof(relem_t) + (intern_mode ? 1 : len + 1);
+}
+
+/*
+ * Store string s of length len to element e, as a copy or, while intern_mode
+ * is set, as the shared copy of the interning table.
+ * Return false if could not allocate space.
+ */
+static bool __r_set(relem_t *e, const char *s, size_t len)
+{
+    if (intern_mode) {
+        e->value = intern_get(s, len);
+        if (!e->value)
+            return false;
+        e->str[0] = STR_INTERNED;
+    } else {
+        memcpy(e->str, s, len + 1);
+        e->value = e->str;
+    }
+    e->len = len;
+    return true;
+}
+
+/*
+ * Allocate an element holding string s
+ */
+static relem_t *__r_new(const char *s)
+{
+    size_t len = strlen(s);
+    relem_t *e = slab_alloc(__r_size(len));
+    if (!e)
+        return NULL;
+    if (!__r_set(e, s, len)) {
+        slab_free(e);
+        return NULL;
+    }
+    return e;
+}
+
+/*
+ * Return whether the value of e is a string of the interning table
+ */
+static inline bool __r_interned(relem_t *e)
+{
+    return e->value != e->str && e->str[0] == STR_INTERNED;
+}
+
+/*
+ * Return whether elements a and b have equal values. Two interned strings
+ * are equal only if they are the same string.
+ */
+static inline bool __r_same(relem_t *a, relem_t *b)
+{
+    if (a->value == b->value)
+        return true;
+    if (__r_interned(a) && __r_interned(b))
+        return false;
+    return !strcmp(a->value, b->value);
+}
+
+/*
+ * Allocate an element adopting string s as its value
+ */
+static relem_t *__r_adopt(char *s)
+{
+    relem_t *e = slab_alloc(sizeof(relem_t) + 1);
+    if (!e)
+        return NULL;
+    e->str[0] = STR_ADOPTED;
+    e->value = s;
+    e->len = strlen(s);
+    return e;
+}
+
+/*
+ * Release element e along with its string, wherever it lives
+ */
+static inline void __r_free(relem_t *e)
+{
+    if (__r_interned(e))
+        intern_put(e->value);
+    else if (e->value != e->str)
+        free(e->value);
+    slab_free(e);
+}
+
+/*
+ * Release element e that could not be linked, but not a string it adopted,
+ * which stays with the caller
+ */
+static inline void __r_drop(relem_t *e)
+{
+    if (__r_interned(e))
+        intern_put(e->value);
+    slab_free(e);
+}
+
+/*
+ * Double the capacity of the array, unwrapping it to start at slot 0.
+ * Return false if the larger array could not be allocated.
+ */
+static bool __r_grow(queue_t *q)
+{
+    relem_t **ring = malloc(2 * q->cap * sizeof(relem_t *));
+    if (!ring)
+        return false;
+    for (size_t k = 0; k < (size_t) q->size; k++)
+        ring[k] = *__r_phys(q, k);
+    free(q->ring);
+    q->ring = ring;
+    q->cap *= 2;
+    q->first = 0;
+    return true;
+}
+
+/*
+ * Add e at the start (front) or the end of the array
+ */
+static bool __r_push(queue_t *q, relem_t *e, bool front)
+{
+    if ((size_t) q->size == q->cap && !__r_grow(q))
+        return false;
+    if (front) {
+        q->first = (q->first - 1) & (q->cap - 1);
+        q->ring[q->first] = e;
+    } else {
+        *__r_phys(q, q->size) = e;
+    }
+    q->size++;
+    return true;
+}
+
+/*
+ * Take the element at the start (front) or the end of the array
+ */
+static inline relem_t *__r_pop(queue_t *q, bool front)
+{
+    relem_t *e;
+    if (front) {
+        e = q->ring[q->first];
+        q->first = (q->first + 1) & (q->cap - 1);
+    } else {
+        e = *__r_phys(q, q->size - 1);
+    }
+    q->size--;
+    return e;
+}
+
+/*
+ * Release the element at index k in queue order, moving the elements on the
+ * shorter side over it
+ */
+static void __r_delete_at(queue_t *q, size_t k)
+{
+    size_t n = q->size;
+
+    __r_free(*__r_at(q, k));
+    if (k < n - 1 - k) {
+        for (; k > 0; k--)
+            *__r_at(q, k) = *__r_at(q, k - 1);
+        __r_pop(q, !q->reversed);
+    } else {
+        for (; k < n - 1; k++)
+            *__r_at(q, k) = *__r_at(q, k + 1);
+        __r_pop(q, q->reversed);
+    }
+}
+
+/*
+ * Drop the slots set to NULL, keeping the others in queue order
+ */
+static void __r_compact(queue_t *q)
+{
+    size_t n = q->size, w = 0;
+    for (size_t r = 0; r < n; r++) {
+        relem_t *e = *__r_at(q, r);
+        if (e)
+            *__r_at(q, w++) = e;
+    }
+    // In reverse order the kept elements end at the last slot
+    if (q->reversed)
+        q->first = (q->first + n - w) & (q->cap - 1);
+    q->size = w;
+}
+
+/*
+ * Hash a string: FNV-1a run through the splitmix64 finalizer
+ */
+static uint64_t __r_hash(const char *s)
+{
+    uint64_t h = 0xcbf29ce484222325;
+
+    for (; *s; s++)
+        h = (h ^ (unsigned char) *s) * 0x100000001b3;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+    return h ^ (h >> 31);
+}
+
+/*
+ * Create empty queue.
+ * Return NULL if could not allocate space.
+ */
+struct list_head *q_new()
+{
+    queue_t *q = malloc(sizeof(queue_t));
+    if (!q)
+        return NULL;
+    q->ring = malloc(RING_MIN_CAP * sizeof(relem_t *));
+    if (!q->ring) {
+        free(q);
+        return NULL;
+    }
+    INIT_LIST_HEAD(&q->head);
+    q->size = 0;
+    q->reversed = false;
+    q->cap = RING_MIN_CAP;
+    q->first = 0;
+    return &q->head;
+}
+
+/* Free all storage used by queue */
+void q_free(struct list_head *l)
+{
+    if (!l)
+        return;
+    queue_t *q = __q_of(l);
+    for (size_t k = 0; k < (size_t) q->size; k++)
+        __r_free(*__r_phys(q, k));
+    free(q->ring);
+    free(q);
+}
+
+/*
+ * Add element e at the start (front) or the end of the array. On failure e
+ * is released, but not a string it adopted.
+ * Return false if e is NULL or could not allocate space.
+ */
+static bool __r_add(queue_t *q, relem_t *e, bool front)
+{
+    if (!e)
+        return false;
+    if (!__r_push(q, e, front)) {
+        __r_drop(e);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Attempt to insert element at head of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ * Argument s points to the string to be stored.
+ * The function must explicitly allocate space and copy the string into it.
+ */
+bool q_insert_head(struct list_head *head, char *s)
+{
+    if (!head)
+        return false;
+    queue_t *q = __q_of(head);
+    return __r_add(q, __r_new(s), !q->reversed);
+}
+
+/*
+ * Attempt to insert element at tail of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ * Argument s points to the string to be stored.
+ * The function must explicitly allocate space and copy the string into it.
+ */
+bool q_insert_tail(struct list_head *head, char *s)
+{
+    if (!head)
+        return false;
+    queue_t *q = __q_of(head);
+    return __r_add(q, __r_new(s), q->reversed);
+}
+
+/*
+ * Attempt to insert element at head of queue adopting buffer s, see
+ * queue_take.h
+ */
+bool q_insert_head_take(struct list_head *head, char *s)
+{
+    if (!head || !s)
+        return false;
+    queue_t *q = __q_of(head);
+    return __r_add(q, __r_adopt(s), !q->reversed);
+}
+
+/*
+ * Attempt to insert element at tail of queue adopting buffer s, see
+ * queue_take.h
+ */
+bool q_insert_tail_take(struct list_head *head, char *s)
+{
+    if (!head || !s)
+        return false;
+    queue_t *q = __q_of(head);
+    return __r_add(q, __r_adopt(s), q->reversed);
+}
+
+/*
+ * Insert the n strings of s one after the other at the start (front) or the
+ * end of the array, whose capacity is raised beforehand. Elements come from
+ * a single arena.
+ */
+static bool __r_push_bulk(queue_t *q, char **s, int n, bool front)
+{
+    while (q->cap - q->size < (size_t) n) {
+        if (!__r_grow(q))
+            return false;
+    }
+    size_t bytes = 0;
+    for (int i = 0; i < n; i++)
+        bytes += slab_arena_size(__r_size(strlen(s[i])));
+    slab_arena_t *arena = slab_arena_new(bytes);
+    if (!arena)
+        return false;
+
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(s[i]);
+        relem_t *e = slab_arena_alloc(arena, __r_size(len));
+        if (!__r_set(e, s[i], len)) {
+            // Take the i elements pushed so far off again; the arena goes
+            // back with the last of its elements
+            slab_free(e);
+            while (i--)
+                __r_free(__r_pop(q, front));
+            return false;
+        }
+        __r_push(q, e, front);
+    }
+    return true;
+}
+
+/*
+ * Attempt to insert the n strings of s at head of queue, see queue_bulk.h
+ */
+bool q_insert_head_bulk(struct list_head *head, char **s, int n)
+{
+    if (!head)
+        return false;
+    return n <= 0 || __r_push_bulk(__q_of(head), s, n, !__q_of(head)->reversed);
+}
+
+/*
+ * Attempt to insert the n strings of s at tail of queue, see queue_bulk.h
+ */
+bool q_insert_tail_bulk(struct list_head *head, char **s, int n)
+{
+    if (!head)
+        return false;
+    return n <= 0 || __r_push_bulk(__q_of(head), s, n, __q_of(head)->reversed);
+}
+
+/*
+ * Copy the value of e to sp, up to bufsize - 1 characters. Only the string
+ * is written, not the rest of the buffer as strncpy would.
+ */
+static inline element_t *__r_out(relem_t *e, char *sp, size_t bufsize)
+{
+    if (sp && bufsize) {
+        size_t len = e->len < bufsize - 1 ? e->len : bufsize - 1;
+        memcpy(sp, e->value, len);
+        sp[len] = '\0';
+    }
+    return (element_t *) e;
+}
+
+/*
+ * Attempt to remove element from head of queue.
+ * Return target element, of which only the value field may be used.
+ * Return NULL if queue is NULL or empty.
+ * If sp is non-NULL and an element is removed, copy the removed string to *sp
+ * (up to a maximum of bufsize-1 characters, plus a null terminator.)
+ */
+element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
+{
+    if (!head || !__q_of(head)->size)
+        return NULL;
+    queue_t *q = __q_of(head);
+    return __r_out(__r_pop(q, !q->reversed), sp, bufsize);
+}
+
+/*
+ * Attempt to remove element from tail of queue.
+ * Other attribute is as same as q_remove_head.
+ */
+element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
+{
+    if (!head || !__q_of(head)->size)
+        return NULL;
+    queue_t *q = __q_of(head);
+    return __r_out(__r_pop(q, q->reversed), sp, bufsize);
+}
+
+/*
+ * Attempt to remove up to n elements from head of queue, see queue_bulk.h
+ */
+int q_remove_head_bulk(struct list_head *head, int n, element_t **out)
+{
+    if (!head || n <= 0)
+        return 0;
+    queue_t *q = __q_of(head);
+    int k = 0;
+    for (; k < n && q->size; k++)
+        out[k] = (element_t *) __r_pop(q, !q->reversed);
+    return k;
+}
+
+/*
+ * Remove the element at head or tail of queue and release it, returning its
+ * string as a block of its own. A string that was not adopted is duplicated
+ * first, so that failing to leaves the queue unchanged.
+ */
+static char *__r_take(struct list_head *head, bool tail)
+{
+    if (!head || !__q_of(head)->size)
+        return NULL;
+    queue_t *q = __q_of(head);
+    relem_t *e = *__r_at(q, tail ? q->size - 1 : 0);
+    char *s = e->value;
+    bool adopted = s != e->str && e->str[0] == STR_ADOPTED;
+    if (!adopted && !(s = strdup(s)))
+        return NULL;
+    __r_pop(q, tail == q->reversed);
+    if (adopted)
+        slab_free(e);
+    else
+        __r_free(e);
+    return s;
+}
+
+/*
+ * Attempt to remove element from head of queue handing its string over, see
+ * queue_take.h
+ */
+char *q_remove_head_take(struct list_head *head)
+{
+    return __r_take(head, false);
+}
+
+/*
+ * Attempt to remove element from tail of queue handing its string over, see
+ * queue_take.h
+ */
+char *q_remove_tail_take(struct list_head *head)
+{
+    return __r_take(head, true);
+}
+
+/*
+ * WARN: This is for external usage, don't modify it
+ * Attempt to release element.
+ * The string lives in the same block as the value pointer (see __r_new),
+ * unless it was adopted (see __r_adopt).
+ */
+void q_release_element(element_t *e)
+{
+    __r_free((relem_t *) e);
+}
+
+/*
+ * Return number of elements in queue.
+ * Return 0 if q is NULL or empty
+ */
+int q_size(struct list_head *head)
+{
+    if (!head)
+        return 0;
+    return __q_of(head)->size;
+}
+
+/*
+ * Delete the middle node in list.
+ * The middle node of a linked list of size n is the
+ * ⌊n / 2⌋th node from the start using 0-based indexing.
+ * Return false if list is NULL or empty.
+ *
+ * The elements on the shorter side of the middle one are moved over it.
+ */
+bool q_delete_mid(struct list_head *head)
+{
+    if (!head || !__q_of(head)->size)
+        return false;
+    __r_delete_at(__q_of(head), __q_of(head)->size / 2);
+    return true;
+}
+
+/*
+ * Delete all nodes that have duplicate string,
+ * leaving only distinct strings from the original list.
+ * Return true if successful.
+ * Return false if list is NULL or empty.
+ *
+ * Note: this function always be called after sorting, in other words,
+ * list is guaranteed to be sorted in ascending order.
+ */
+bool q_delete_dup(struct list_head *head)
+{
+    if (!head || !__q_of(head)->size)
+        return false;
+    queue_t *q = __q_of(head);
+    size_t n = q->size, first = 0;
+    bool dup = false;
+
+    // Clear the slots of deleted elements, then close the gaps at once
+    for (size_t i = 1; i <= n; i++) {
+        relem_t **cur = i < n ? __r_at(q, i) : NULL;
+        relem_t **group = __r_at(q, first);
+        if (cur && __r_same(*group, *cur)) {
+            __r_free(*cur);
+            *cur = NULL;
+            dup = true;
+            continue;
+        }
+        if (dup) {
+            __r_free(*group);
+            *group = NULL;
+            dup = false;
+        }
+        first = i;
+    }
+
+    __r_compact(q);
+    return true;
+}
+
+/* Slot of the hash table behind q_delete_dup_unsorted */
+typedef struct {
+    uint64_t hash;
+    /* Queue slot of the first element seen with this value, NULL if empty */
+    relem_t **slot;
+    bool dup;
+} __r_dedup_slot_t;
+
+/*
+ * Delete all nodes whose string occurs more than once, on a queue in any
+ * order, with the same open-addressing table as the list backend. Return
+ * false if queue is NULL or empty, or if the table could not be allocated,
+ * in which case the queue is left unchanged.
+ */
+bool q_delete_dup_unsorted(struct list_head *head)
+{
+    if (!head || !__q_of(head)->size)
+        return false;
+
+    queue_t *q = __q_of(head);
+    size_t cap = 2;
+    while (cap < 2 * (size_t) q->size)
+        cap <<= 1;
+    __r_dedup_slot_t *table = malloc(cap * sizeof(__r_dedup_slot_t));
+    if (!table)
+        return false;
+    memset(table, 0, cap * sizeof(__r_dedup_slot_t));
+
+    for (size_t k = 0; k < (size_t) q->size; k++) {
+        relem_t **cur = __r_at(q, k);
+        uint64_t hash = __r_hash((*cur)->value);
+        size_t i = hash & (cap - 1);
+        while (table[i].slot &&
+               (table[i].hash != hash ||
+                strcmp((*table[i].slot)->value, (*cur)->value)))
+            i = (i + 1) & (cap - 1);
+
+        if (!table[i].slot) {
+            table[i].hash = hash;
+            table[i].slot = cur;
+            continue;
+        }
+        table[i].dup = true;
+        __r_free(*cur);
+        *cur = NULL;
+    }
+
+    for (size_t i = 0; i < cap; i++) {
+        if (!table[i].dup)
+            continue;
+        __r_free(*table[i].slot);
+        *table[i].slot = NULL;
+    }
+
+    free(table);
+    __r_compact(q);
+    return true;
+}
+
+/*
+ * Attempt to swap every two adjacent nodes.
+ */
+void q_swap(struct list_head *head)
+{
+    if (!head)
+        return;
+    queue_t *q = __q_of(head);
+    for (size_t i = 0; i + 1 < (size_t) q->size; i += 2) {
+        relem_t **a = __r_at(q, i), **b = __r_at(q, i + 1);
+        relem_t *tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+}
+
+/*
+ * Reverse elements in queue
+ * No effect if q is NULL or empty
+ * Only the direction in which the array is read changes.
+ */
+void q_reverse(struct list_head *head)
+{
+    if (!head)
+        return;
+    __q_of(head)->reversed ^= true;
+}
+
+/* Element and its key prefix, as sorted by q_sort */
+typedef struct {
+    uint64_t key;
+    relem_t *e;
+} __r_item_t;
+
+/* Runs sorted by insertion before merging */
+#define SORT_RUN 16
+
+static inline int __r_cmp(const __r_item_t *a, const __r_item_t *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    // Equal keys with a zero last byte mean both strings ended early
+    if (!(a->key & 0xff))
+        return 0;
+    return strcmp(a->e->value + KEY_PREFIX_LEN, b->e->value + KEY_PREFIX_LEN);
+}
+
+/*
+ * Sort elements of queue in ascending order
+ * No effect if q is NULL or empty. In addition, if q has only one
+ * element, do nothing.
+ *
+ * The elements and their key prefixes are gathered into an array mapped
+ * from the kernel (qtest sorts in no-allocate mode), sorted there with a
+ * stable bottom-up merge sort, and written back from the first slot in
+ * forward order. Nothing happens if the array cannot be mapped.
+ */
+void q_sort(struct list_head *head)
+{
+    if (!head)
+        return;
+    queue_t *q = __q_of(head);
+    size_t n = q->size;
+    if (n < 2)
+        return;
+
+    size_t bytes = 2 * n * sizeof(__r_item_t);
+    __r_item_t *src = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (src == MAP_FAILED)
+        return;
+    __r_item_t *dst = src + n, *buf = src;
+
+    for (size_t i = 0; i < n; i++) {
+        src[i].e = *__r_at(q, i);
+        src[i].key = __q_key(src[i].e->value);
+    }
+
+    for (size_t lo = 0; lo < n; lo += SORT_RUN) {
+        size_t hi = lo + SORT_RUN < n ? lo + SORT_RUN : n;
+        for (size_t i = lo + 1; i < hi; i++) {
+            __r_item_t x = src[i];
+            size_t j = i;
+            for (; j > lo && __r_cmp(&x, &src[j - 1]) < 0; j--)
+                src[j] = src[j - 1];
+            src[j] = x;
+        }
+    }
+
+    for (size_t width = SORT_RUN; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi)
+                dst[k++] = __r_cmp(&src[j], &src[i]) < 0 ? src[j++] : src[i++];
+            while (i < mid)
+                dst[k++] = src[i++];
+            while (j < hi)
+                dst[k++] = src[j++];
+        }
+        __r_item_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    q->reversed = false;
+    for (size_t i = 0; i < n; i++)
+        *__r_phys(q, i) = src[i].e;
+
+    munmap(buf, bytes);
+}
+
+/*
+ * Read position of a queue taking part in a merge, with the next element
+ * and its key prefix at hand for the matches of the loser tree
+ */
+typedef struct {
+    queue_t *q;
+    size_t i;
+    __r_item_t next;
+} __r_cursor_t;
+
+/*
+ * Load the element at the position of cursor c, if any
+ */
+static inline void __r_cursor_load(__r_cursor_t *c)
+{
+    if (c->i == (size_t) c->q->size)
+        return;
+    c->next.e = *__r_at(c->q, c->i);
+    c->next.key = __q_key(c->next.e->value);
+}
+
+/*
+ * Whether the next element of cursor a goes before the one of cursor b in
+ * a merge, ties going to the earlier queue. Exhausted cursors lose.
+ */
+static bool __r_merge_beats(void *ctx, int a, int b)
+{
+    __r_cursor_t *cur = ctx;
+    if (cur[a].i == (size_t) cur[a].q->size)
+        return false;
+    if (cur[b].i == (size_t) cur[b].q->size)
+        return true;
+    int cmp = __r_cmp(&cur[a].next, &cur[b].next);
+    return cmp < 0 || (cmp == 0 && a < b);
+}
+
+/*
+ * Merge sorted queues into the first one, see queue_merge.h, past
+ * LOSER_TREE_MAX queues in O(N k / LOSER_TREE_MAX) as stated there. The
+ * first queue and up to LOSER_TREE_MAX - 1 others are merged at each pass, into
+ * an array large enough for all the elements, which then becomes the ring
+ * of the first queue. With more than one pass, two such arrays take turns,
+ * both allocated before anything moves.
+ */
+int q_merge(struct list_head *head)
+{
+    if (!head || list_empty(head))
+        return 0;
+
+    queue_context_t *first = list_first_entry(head, queue_context_t, chain);
+    if (!first->q)
+        return 0;
+    queue_t *fq = __q_of(first->q);
+
+    size_t total = 0;
+    int others = 0;
+    queue_context_t *ctx;
+    list_for_each_entry (ctx, head, chain) {
+        if (ctx->q && ctx != first && __q_of(ctx->q)->size) {
+            total += __q_of(ctx->q)->size;
+            others++;
+        }
+    }
+    if (!others) {
+        first->size = fq->size;
+        return first->size;
+    }
+    total += fq->size;
+
+    size_t cap = RING_MIN_CAP;
+    while (cap < total)
+        cap <<= 1;
+    relem_t **buf[2] = {NULL, NULL};
+    int nbuf = others > LOSER_TREE_MAX - 1 ? 2 : 1;
+    for (int b = 0; b < nbuf; b++) {
+        buf[b] = malloc(cap * sizeof(relem_t *));
+        if (!buf[b]) {
+            free(buf[0]);
+            return -1;
+        }
+    }
+
+    __r_cursor_t cur[LOSER_TREE_MAX];
+    int tree[LOSER_TREE_MAX];
+    struct list_head *pos = first->chain.next;
+    for (int pass = 0; pos != head; pass++) {
+        int k = 0;
+        cur[k++].q = fq;
+        for (; pos != head && k < LOSER_TREE_MAX; pos = pos->next) {
+            ctx = list_entry(pos, queue_context_t, chain);
+            if (ctx->q && __q_of(ctx->q)->size)
+                cur[k++].q = __q_of(ctx->q);
+            ctx->size = 0;
+        }
+        for (int i = 0; i < k; i++) {
+            cur[i].i = 0;
+            __r_cursor_load(&cur[i]);
+        }
+
+        relem_t **out = buf[pass & 1];
+        size_t n = 0;
+        loser_tree_build(tree, k, __r_merge_beats, cur);
+        while (cur[tree[0]].i < (size_t) cur[tree[0]].q->size) {
+            int w = tree[0];
+            out[n++] = cur[w].next.e;
+            cur[w].i++;
+            __r_cursor_load(&cur[w]);
+            loser_tree_replay(tree, k, w, __r_merge_beats, cur);
+        }
+
+        for (int i = 1; i < k; i++) {
+            cur[i].q->size = 0;
+            cur[i].q->first = 0;
+            cur[i].q->reversed = false;
+        }
+        if (fq->ring != buf[0] && fq->ring != buf[1])
+            free(fq->ring);
+        fq->ring = out;
+        fq->cap = cap;
+        fq->first = 0;
+        fq->reversed = false;
+        fq->size = n;
+    }
+
+    if (nbuf == 2)
+        free(fq->ring == buf[0] ? buf[1] : buf[0]);
+    first->size = fq->size;
+    return first->size;
+}
+
+/*
+ * Return the index in queue order of the first element after string s, or
+ * not before it unless after is set, found by binary search
+ */
+static size_t __r_seek(queue_t *q, const char *s, bool after)
+{
+    size_t lo = 0, hi = q->size;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp((*__r_at(q, mid))->value, s);
+        if (cmp < 0 || (after && cmp == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Attempt to insert a copy of s at its place in the queue, see
+ * queue_sorted.h. The place is found by binary search, then the elements on
+ * the shorter side of it move over by one slot.
+ */
+bool q_insert_sorted(struct list_head *head, char *s)
+{
+    if (!head)
+        return false;
+    queue_t *q = __q_of(head);
+    relem_t *e = __r_new(s);
+    if (!e)
+        return false;
+
+    size_t n = q->size, k = __r_seek(q, s, true);
+    bool front = k < n - k;
+    if (!__r_push(q, e, front != q->reversed)) {
+        __r_free(e);
+        return false;
+    }
+    if (front) {
+        for (size_t i = 0; i < k; i++)
+            *__r_at(q, i) = *__r_at(q, i + 1);
+    } else {
+        for (size_t i = n; i > k; i--)
+            *__r_at(q, i) = *__r_at(q, i - 1);
+    }
+    *__r_at(q, k) = e;
+    return true;
+}
+
+/*
+ * Look up an element equal to s by binary search, see queue_sorted.h
+ */
+char *q_find_sorted(struct list_head *head, const char *s)
+{
+    if (!head)
+        return NULL;
+    queue_t *q = __q_of(head);
+    size_t k = __r_seek(q, s, false);
+    if (k == (size_t) q->size || strcmp((*__r_at(q, k))->value, s))
+        return NULL;
+    return (*__r_at(q, k))->value;
+}
+
+/*
+ * Delete the first element equal to s, found by binary search, see
+ * queue_sorted.h
+ */
+bool q_delete_sorted(struct list_head *head, const char *s)
+{
+    if (!head)
+        return false;
+    queue_t *q = __q_of(head);
+    size_t k = __r_seek(q, s, false);
+    if (k == (size_t) q->size || strcmp((*__r_at(q, k))->value, s))
+        return false;
+    __r_delete_at(q, k);
+    return true;
+}
+
+/* State of the splitmix64 generator behind q_shuffle, 0 until seeded */
+static uint64_t shuffle_state = 0;
+
+/*
+ * Seed the shuffle PRNG, making q_shuffle reproducible
+ */
+void q_shuffle_seed(uint64_t seed)
+{
+    shuffle_state = seed ? seed : 1;
+}
+
+/*
+ * splitmix64, as in queue.c
+ */
+static uint64_t __q_rand()
+{
+    uint64_t z = (shuffle_state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Unbiased random integer in [0, bound), as in queue.c
+ */
+static uint64_t __q_rand_below(uint64_t bound)
+{
+    __uint128_t m = (__uint128_t) __q_rand() * bound;
+    uint64_t low = (uint64_t) m;
+    if (low < bound) {
+        uint64_t threshold = -bound % bound;
+        while (low < threshold) {
+            m = (__uint128_t) __q_rand() * bound;
+            low = (uint64_t) m;
+        }
+    }
+    return m >> 64;
+}
+
+/*
+ * Fisher–Yates shuffle, right on the array
+ */
+void q_shuffle(struct list_head *head)
+{
+    if (!head)
+        return;
+    queue_t *q = __q_of(head);
+    if (q->size < 2)
+        return;
+
+    if (!shuffle_state)
+        q_shuffle_seed(((uint64_t) rand() << 32) ^ rand());
+    for (size_t i = q->size - 1; i > 0; i--) {
+        relem_t **a = __r_phys(q, i), **b = __r_phys(q, __q_rand_below(i + 1));
+        relem_t *tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+}
+
+/*
+ * Cursor over queue elements, see queue_iter.h. The cursor is an index in
+ * queue order.
+ */
+char *q_iter_first(struct list_head *head, q_iter_t *it)
+{
+    if (!head)
+        return NULL;
+    it->idx = -1;
+    return q_iter_next(head, it);
+}
+
+char *q_iter_last(struct list_head *head, q_iter_t *it)
+{
+    if (!head || !__q_of(head)->size)
+        return NULL;
+    it->idx = __q_of(head)->size - 1;
+    return (*__r_at(__q_of(head), it->idx))->value;
+}
+
+char *q_iter_next(struct list_head *head, q_iter_t *it)
+{
+    queue_t *q = __q_of(head);
+    if (++it->idx >= q->size)
+        return NULL;
+    return (*__r_at(q, it->idx))->value;
+}
@@ -0,0 +1,50 @@
+#ifndef LAB0_QUEUE_SORTED_H
+#define LAB0_QUEUE_SORTED_H
+
+/*
+ * Ordered inserts, lookups and deletes, provided by every backend next to
+ * the operations of queue.h, for queues kept in ascending order all the
+ * time instead of appended to and sorted again.
+ *
+ * The list backend links the elements inserted this way into a skip list as
+ * well, whose level 0 is the list handed out by q_new() itself, so these
+ * operations cost O(log n) on average and every other one walks the list as
+ * before. Elements inserted any other way are only on level 0 and lengthen the
+ * walks between the others. The skip list survives removals at either end and
+ * inserts at either end that keep the queue in order; any other change drops
+ * its levels, and the next call below links the towers of its elements again in
+ * O(n), without moving or allocating any. The other backends search their array
+ * in O(log n), or walk their list, and move elements over.
+ *
+ * None of these operations reorders the queue. On a queue not in ascending
+ * order, where an element is inserted is unspecified, and a lookup or
+ * delete may miss an element it holds; the list backend, which checks the
+ * order as it links its skip list again, then always misses.
+ */
+
+#include <stdbool.h>
+
+#include "list.h"
+
+/*
+ * Attempt to insert a copy of string s at its place in the queue, after the
+ * elements equal to it.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ */
+bool q_insert_sorted(struct list_head *head, char *s);
+
+/*
+ * Look up an element whose value equals string s.
+ * Return its value, or NULL if q is NULL or holds no such element.
+ */
+char *q_find_sorted(struct list_head *head, const char *s);
+
+/*
+ * Delete the first element whose value equals string s.
+ * Return true if an element was deleted.
+ * Return false if q is NULL or holds no such element.
+ */
+bool q_delete_sorted(struct list_head *head, const char *s);
+
+#endif /* LAB0_QUEUE_SORTED_H */
@@ -0,0 +1,56 @@
+#ifndef LAB0_QUEUE_TAKE_H
+#define LAB0_QUEUE_TAKE_H
+
+/*
+ * Ownership-transferring insert and remove, provided by every backend next
+ * to the operations of queue.h.
+ *
+ * q_insert_head() and q_insert_tail() copy the string into the element, so a
+ * producer that already holds the string in a buffer of its own pays for a
+ * second copy and a second free. The calls below adopt the buffer instead:
+ * it must come from malloc() or strdup() of the test harness, and belongs to
+ * the queue from then on. The harness keeps tracking it as one more block,
+ * released with the element by q_release_element() or q_free().
+ *
+ * The remove calls hand the string back as such a buffer, to be freed by the
+ * caller. An adopted buffer goes back as it is; a string copied in by the
+ * other insert calls is duplicated once.
+ */
+
+#include <stdbool.h>
+
+#include "list.h"
+
+/*
+ * Attempt to insert element at head of queue, adopting buffer s as its
+ * value.
+ * Return true if successful.
+ * Return false if q or s is NULL or could not allocate space, in which case
+ * s still belongs to the caller.
+ */
+bool q_insert_head_take(struct list_head *head, char *s);
+
+/*
+ * Attempt to insert element at tail of queue, adopting buffer s as its
+ * value.
+ * Other attribute is as same as q_insert_head_take.
+ */
+bool q_insert_tail_take(struct list_head *head, char *s);
+
+/*
+ * Attempt to remove element from head of queue and release it, handing its
+ * string over to the caller.
+ * Return the string, to be freed with free().
+ * Return NULL if queue is NULL or empty, or could not allocate space for a
+ * string that was not adopted, in which case the queue is left unchanged.
+ */
+char *q_remove_head_take(struct list_head *head);
+
+/*
+ * Attempt to remove element from tail of queue and release it, handing its
+ * string over to the caller.
+ * Other attribute is as same as q_remove_head_take.
+ */
+char *q_remove_tail_take(struct list_head *head);
+
+#endif /* LAB0_QUEUE_TAKE_H */
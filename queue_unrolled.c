@@ -0,0 +1,1350 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "harness.h"
+#include "intern.h"
+#include "loser_tree.h"
+#include "queue.h"
+#include "queue_bulk.h"
+#include "queue_iter.h"
+#include "queue_merge.h"
+#include "queue_sorted.h"
+#include "queue_take.h"
+#include "slab.h"
+
+/*
+ * Unrolled-list backend of the queue operations, built instead of queue.c
+ * with `make QUEUE=unrolled`.
+ *
+ * The list handed out by q_new() links blocks rather than elements. Each
+ * block keeps up to BLOCK_SLOTS element pointers in a contiguous window of
+ * its slot array, so inserts and removes on either end are O(1) and an
+ * element costs one pointer instead of two list links. Walking the queue
+ * touches one block per window of elements, and sort and shuffle run on a
+ * flat array gathered from the blocks.
+ *
+ * An element is allocated as its value pointer and length followed by the
+ * string, or by a tag when its value lives elsewhere: adopted (see
+ * queue_take.h) or interned (see intern.h). The element_t returned by
+ * q_remove_head() and q_remove_tail() is only valid for its value field: the
+ * list links are not part of the allocation.
+ */
+
+/* Element pointers per block, sized for a block of about 512 bytes */
+#define BLOCK_SLOTS 60
+
+#define KEY_PREFIX_LEN sizeof(uint64_t)
+
+/* Tags left in str by an element whose value lives elsewhere */
+#define STR_ADOPTED '\0'
+#define STR_INTERNED '\1'
+
+/*
+ * Element as allocated by this backend, the leading part of element_t. len
+ * is the length of the string, copied out by removals without scanning it.
+ */
+typedef struct {
+    char *value;
+    size_t len;
+    char str[];
+} uelem_t;
+
+typedef struct {
+    struct list_head list;
+    /* Elements occupy slot[start] to slot[start + count - 1] */
+    int start, count;
+    uelem_t *slot[BLOCK_SLOTS];
+} block_t;
+
+/*
+ * Queue descriptor, with the list head handed out by q_new() embedded at its
+ * start. Blocks linked to head are never empty.
+ */
+typedef struct {
+    struct list_head head;
+    /* Number of elements in all blocks */
+    int size;
+    /* Last block emptied, kept to absorb insert/remove churn on the ends */
+    block_t *spare;
+} queue_t;
+
+/*
+ * Declaring a helper functions here given to the fact that queue.h is not
+ * allowed to be changed.
+ */
+
+/*
+ * Return the descriptor owning the given list head
+ */
+static inline queue_t *__q_of(struct list_head *head)
+{
+    return container_of(head, queue_t, head);
+}
+
+/*
+ * Return the block holding the given list node
+ */
+static inline block_t *__blk(struct list_head *node)
+{
+    return container_of(node, block_t, list);
+}
+
+/*
+ * Pack the order-preserving key prefix of string s, as queue.c does
+ */
+static inline uint64_t __q_key(const char *s)
+{
+    uint64_t key = 0;
+    size_t i = 0;
+
+    for (; i < KEY_PREFIX_LEN && s[i]; i++)
+        key = (key << 8) | (unsigned char) s[i];
+    return key << (8 * (KEY_PREFIX_LEN - i));
+}
+
+/*
+ * Bytes of an element holding a string of length len, which is only stored
+ * in the element while interning is off
+ */
+static inline size_t __u_size(size_t len)
+{
+    return sizeof(uelem_t) + (intern_mode ? 1 : len + 1);
+}
+
+/*
+ * Store string s of length len to element e, as a copy or, while intern_mode
+ * is set, as the shared copy of the interning table.
+ * Return false if could not allocate space.
+ */
+static bool __u_set(uelem_t *e, const char *s, size_t len)
+{
+    if (intern_mode) {
+        e->value = intern_get(s, len);
+        if (!e->value)
+            return false;
+        e->str[0] = STR_INTERNED;
+    } else {
+        memcpy(e->str, s, len + 1);
+        e->value = e->str;
+    }
+    e->len = len;
+    return true;
+}
+
+/*
+ * Allocate an element holding string s
+ */
+static uelem_t *__u_new(const char *s)
+{
+    size_t len = strlen(s);
+    uelem_t *e = slab_alloc(__u_size(len));
+    if (!e)
+        return NULL;
+    if (!__u_set(e, s, len)) {
+        slab_free(e);
+        return NULL;
+    }
+    return e;
+}
+
+/*
+ * Return whether the value of e is a string of the interning table
+ */
+static inline bool __u_interned(uelem_t *e)
+{
+    return e->value != e->str && e->str[0] == STR_INTERNED;
+}
+
+/*
+ * Return whether elements a and b have equal values. Two interned strings
+ * are equal only if they are the same string.
+ */
+static inline bool __u_same(uelem_t *a, uelem_t *b)
+{
+    if (a->value == b->value)
+        return true;
+    if (__u_interned(a) && __u_interned(b))
+        return false;
+    return !strcmp(a->value, b->value);
+}
+
+/*
+ * Allocate an element adopting string s as its value
+ */
+static uelem_t *__u_adopt(char *s)
+{
+    uelem_t *e = slab_alloc(sizeof(uelem_t) + 1);
+    if (!e)
+        return NULL;
+    e->str[0] = STR_ADOPTED;
+    e->value = s;
+    e->len = strlen(s);
+    return e;
+}
+
+/*
+ * Release element e along with its string, wherever it lives
+ */
+static inline void __u_free(uelem_t *e)
+{
+    if (__u_interned(e))
+        intern_put(e->value);
+    else if (e->value != e->str)
+        free(e->value);
+    slab_free(e);
+}
+
+/*
+ * Release element e that could not be linked, but not a string it adopted,
+ * which stays with the caller
+ */
+static inline void __u_drop(uelem_t *e)
+{
+    if (__u_interned(e))
+        intern_put(e->value);
+    slab_free(e);
+}
+
+/*
+ * Take a block for q, the spare one if any
+ */
+static block_t *__blk_new(queue_t *q)
+{
+    block_t *b = q->spare;
+    if (b)
+        q->spare = NULL;
+    else if (!(b = malloc(sizeof(block_t))))
+        return NULL;
+    b->count = 0;
+    return b;
+}
+
+/*
+ * Unlink block b from q, keeping it as the spare if there is none yet
+ */
+static void __blk_del(queue_t *q, block_t *b)
+{
+    list_del(&b->list);
+    if (q->spare)
+        free(b);
+    else
+        q->spare = b;
+}
+
+/*
+ * Move the window of elements in block b by delta slots
+ */
+static inline void __blk_shift(block_t *b, int delta)
+{
+    memmove(&b->slot[b->start + delta], &b->slot[b->start],
+            b->count * sizeof(uelem_t *));
+    b->start += delta;
+}
+
+/*
+ * Unlink the element in slot idx of block b, moving the shorter side of the
+ * window over it. Release the block once empty.
+ */
+static uelem_t *__blk_take(queue_t *q, block_t *b, int idx)
+{
+    uelem_t *e = b->slot[idx];
+    int end = b->start + b->count - 1;
+
+    if (idx - b->start < end - idx) {
+        memmove(&b->slot[b->start + 1], &b->slot[b->start],
+                (idx - b->start) * sizeof(uelem_t *));
+        b->start++;
+    } else {
+        memmove(&b->slot[idx], &b->slot[idx + 1],
+                (end - idx) * sizeof(uelem_t *));
+    }
+    if (--b->count == 0)
+        __blk_del(q, b);
+    q->size--;
+    return e;
+}
+
+/*
+ * Link element e in block b before slot pos, b->start <= pos <= b->start +
+ * b->count, moving the elements on the shorter side of it. A full block is
+ * split in two first.
+ * Return false if the new block could not be allocated.
+ */
+static bool __blk_insert(queue_t *q, block_t *b, int pos, uelem_t *e)
+{
+    if (b->count == BLOCK_SLOTS) {
+        block_t *nb = __blk_new(q);
+        if (!nb)
+            return false;
+        int half = BLOCK_SLOTS / 2;
+        memcpy(nb->slot, &b->slot[half],
+               (BLOCK_SLOTS - half) * sizeof(uelem_t *));
+        nb->start = 0;
+        nb->count = BLOCK_SLOTS - half;
+        b->count = half;
+        list_add(&nb->list, &b->list);
+        if (pos > half) {
+            b = nb;
+            pos -= half;
+        }
+    }
+
+    int end = b->start + b->count;
+    if (b->start > 0 && (pos - b->start < end - pos || end == BLOCK_SLOTS)) {
+        memmove(&b->slot[b->start - 1], &b->slot[b->start],
+                (pos - b->start) * sizeof(uelem_t *));
+        b->start--;
+        pos--;
+    } else {
+        memmove(&b->slot[pos + 1], &b->slot[pos],
+                (end - pos) * sizeof(uelem_t *));
+    }
+    b->slot[pos] = e;
+    b->count++;
+    q->size++;
+    return true;
+}
+
+/*
+ * Step cursor it to the next element slot of the queue, starting from the
+ * first one when it->node is head. Return the slot, or NULL past the end.
+ */
+static uelem_t **__u_next_slot(struct list_head *head, q_iter_t *it)
+{
+    block_t *b = __blk(it->node);
+    if (it->node != head && ++it->idx < b->start + b->count)
+        return &b->slot[it->idx];
+
+    it->node = it->node->next;
+    if (it->node == head)
+        return NULL;
+    b = __blk(it->node);
+    it->idx = b->start;
+    return &b->slot[it->idx];
+}
+
+/*
+ * Drop the slots set to NULL, then merge every block into its predecessor
+ * when both fit in one, so that blocks stay well filled after deletions
+ */
+static void __u_compact(queue_t *q)
+{
+    struct list_head *node, *safe;
+    block_t *prev = NULL;
+
+    list_for_each_safe (node, safe, &q->head) {
+        block_t *b = __blk(node);
+        int w = b->start;
+        for (int i = b->start; i < b->start + b->count; i++) {
+            if (b->slot[i])
+                b->slot[w++] = b->slot[i];
+        }
+        b->count = w - b->start;
+
+        if (b->count && prev && prev->count + b->count <= BLOCK_SLOTS) {
+            if (prev->start + prev->count + b->count > BLOCK_SLOTS)
+                __blk_shift(prev, -prev->start);
+            memcpy(&prev->slot[prev->start + prev->count], &b->slot[b->start],
+                   b->count * sizeof(uelem_t *));
+            prev->count += b->count;
+            b->count = 0;
+        }
+        if (b->count)
+            prev = b;
+        else
+            __blk_del(q, b);
+    }
+}
+
+/*
+ * Hash a string: FNV-1a run through the splitmix64 finalizer
+ */
+static uint64_t __u_hash(const char *s)
+{
+    uint64_t h = 0xcbf29ce484222325;
+
+    for (; *s; s++)
+        h = (h ^ (unsigned char) *s) * 0x100000001b3;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+    return h ^ (h >> 31);
+}
+
+/*
+ * Create empty queue.
+ * Return NULL if could not allocate space.
+ */
+struct list_head *q_new()
+{
+    queue_t *q = malloc(sizeof(queue_t));
+    if (!q)
+        return NULL;
+    // Start with a spare block, so that the first insert costs no more
+    // than the following ones
+    q->spare = malloc(sizeof(block_t));
+    if (!q->spare) {
+        free(q);
+        return NULL;
+    }
+    INIT_LIST_HEAD(&q->head);
+    q->size = 0;
+    return &q->head;
+}
+
+/* Free all storage used by queue */
+void q_free(struct list_head *l)
+{
+    if (!l)
+        return;
+    queue_t *q = __q_of(l);
+    block_t *b, *safe;
+    list_for_each_entry_safe (b, safe, l, list) {
+        for (int i = b->start; i < b->start + b->count; i++)
+            __u_free(b->slot[i]);
+        free(b);
+    }
+    free(q->spare);
+    free(q);
+}
+
+/*
+ * Link element e at head of queue. On failure e is released, but not a
+ * string it adopted.
+ * Return false if e is NULL or could not allocate space.
+ */
+static bool __u_add_head(struct list_head *head, uelem_t *e)
+{
+    if (!e)
+        return false;
+    queue_t *q = __q_of(head);
+
+    // Windows only grow away from the middle of the queue, and the block
+    // at the other end keeps its free slots, so that the insert costs the
+    // same whatever the queue holds
+    block_t *b = list_empty(head) ? NULL : __blk(head->next);
+    if (!b || b->start == 0) {
+        block_t *nb = __blk_new(q);
+        if (!nb) {
+            __u_drop(e);
+            return false;
+        }
+        nb->start = b ? BLOCK_SLOTS : BLOCK_SLOTS / 2;
+        list_add(&nb->list, head);
+        b = nb;
+    }
+    b->slot[--b->start] = e;
+    b->count++;
+    q->size++;
+    return true;
+}
+
+/*
+ * Link element e at tail of queue.
+ * Other attribute is as same as __u_add_head.
+ */
+static bool __u_add_tail(struct list_head *head, uelem_t *e)
+{
+    if (!e)
+        return false;
+    queue_t *q = __q_of(head);
+
+    block_t *b = list_empty(head) ? NULL : __blk(head->prev);
+    if (!b || b->start + b->count == BLOCK_SLOTS) {
+        block_t *nb = __blk_new(q);
+        if (!nb) {
+            __u_drop(e);
+            return false;
+        }
+        nb->start = b ? 0 : BLOCK_SLOTS / 2;
+        list_add_tail(&nb->list, head);
+        b = nb;
+    }
+    b->slot[b->start + b->count++] = e;
+    q->size++;
+    return true;
+}
+
+/*
+ * Attempt to insert element at head of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ * Argument s points to the string to be stored.
+ * The function must explicitly allocate space and copy the string into it.
+ */
+bool q_insert_head(struct list_head *head, char *s)
+{
+    return head && __u_add_head(head, __u_new(s));
+}
+
+/*
+ * Attempt to insert element at tail of queue.
+ * Return true if successful.
+ * Return false if q is NULL or could not allocate space.
+ * Argument s points to the string to be stored.
+ * The function must explicitly allocate space and copy the string into it.
+ */
+bool q_insert_tail(struct list_head *head, char *s)
+{
+    return head && __u_add_tail(head, __u_new(s));
+}
+
+/*
+ * Attempt to insert element at head of queue adopting buffer s, see
+ * queue_take.h
+ */
+bool q_insert_head_take(struct list_head *head, char *s)
+{
+    return head && s && __u_add_head(head, __u_adopt(s));
+}
+
+/*
+ * Attempt to insert element at tail of queue adopting buffer s, see
+ * queue_take.h
+ */
+bool q_insert_tail_take(struct list_head *head, char *s)
+{
+    return head && s && __u_add_tail(head, __u_adopt(s));
+}
+
+/*
+ * Insert the n strings of s one after the other at the tail of q, or at its
+ * head. Elements come from a single arena, and the blocks they need beyond
+ * the free slots of the end block are taken beforehand, so that nothing
+ * can fail once the queue starts changing.
+ */
+static bool __u_insert_bulk(queue_t *q, char **s, int n, bool tail)
+{
+    struct list_head *head = &q->head;
+    block_t *b = NULL;
+    if (!list_empty(head))
+        b = __blk(tail ? head->prev : head->next);
+    int room = !b ? 0 : tail ? BLOCK_SLOTS - b->start - b->count : b->start;
+    int nblocks = n > room ? (n - room + BLOCK_SLOTS - 1) / BLOCK_SLOTS : 0;
+
+    LIST_HEAD(fresh);
+    size_t bytes = 0;
+    for (int i = 0; i < n; i++)
+        bytes += slab_arena_size(__u_size(strlen(s[i])));
+    slab_arena_t *arena = NULL;
+    bool ok = true;
+    for (int i = 0; ok && i < nblocks; i++) {
+        block_t *nb = __blk_new(q);
+        if (nb)
+            list_add_tail(&nb->list, &fresh);
+        ok = nb != NULL;
+    }
+    if (ok)
+        ok = (arena = slab_arena_new(bytes)) != NULL;
+    if (!ok) {
+        while (!list_empty(&fresh))
+            __blk_del(q, __blk(fresh.next));
+        return false;
+    }
+
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(s[i]);
+        uelem_t *e = slab_arena_alloc(arena, __u_size(len));
+        if (!__u_set(e, s[i], len)) {
+            // Take the i elements linked so far off the end they went to;
+            // the arena goes back with the last of its elements
+            slab_free(e);
+            q->size += i;
+            while (i--)
+                __u_free((uelem_t *) (tail ? q_remove_tail(head, NULL, 0)
+                                           : q_remove_head(head, NULL, 0)));
+            while (!list_empty(&fresh))
+                __blk_del(q, __blk(fresh.next));
+            return false;
+        }
+
+        if (tail) {
+            if (!b || b->start + b->count == BLOCK_SLOTS) {
+                b = __blk(fresh.next);
+                b->start = 0;
+                list_move_tail(&b->list, head);
+            }
+            b->slot[b->start + b->count++] = e;
+        } else {
+            if (!b || b->start == 0) {
+                b = __blk(fresh.next);
+                b->start = BLOCK_SLOTS;
+                list_move(&b->list, head);
+            }
+            b->slot[--b->start] = e;
+            b->count++;
+        }
+    }
+    q->size += n;
+    return true;
+}
+
+/*
+ * Attempt to insert the n strings of s at head of queue, see queue_bulk.h
+ */
+bool q_insert_head_bulk(struct list_head *head, char **s, int n)
+{
+    if (!head)
+        return false;
+    return n <= 0 || __u_insert_bulk(__q_of(head), s, n, false);
+}
+
+/*
+ * Attempt to insert the n strings of s at tail of queue, see queue_bulk.h
+ */
+bool q_insert_tail_bulk(struct list_head *head, char **s, int n)
+{
+    if (!head)
+        return false;
+    return n <= 0 || __u_insert_bulk(__q_of(head), s, n, true);
+}
+
+/*
+ * Copy the value of e to sp, up to bufsize - 1 characters. Only the string
+ * is written, not the rest of the buffer as strncpy would.
+ */
+static inline element_t *__u_out(uelem_t *e, char *sp, size_t bufsize)
+{
+    if (sp && bufsize) {
+        size_t len = e->len < bufsize - 1 ? e->len : bufsize - 1;
+        memcpy(sp, e->value, len);
+        sp[len] = '\0';
+    }
+    return (element_t *) e;
+}
+
+/*
+ * Attempt to remove element from head of queue.
+ * Return target element, of which only the value field may be used.
+ * Return NULL if queue is NULL or empty.
+ * If sp is non-NULL and an element is removed, copy the removed string to *sp
+ * (up to a maximum of bufsize-1 characters, plus a null terminator.)
+ */
+element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
+{
+    if (!head || list_empty(head))
+        return NULL;
+    queue_t *q = __q_of(head);
+    block_t *b = __blk(head->next);
+    uelem_t *e = b->slot[b->start++];
+    if (--b->count == 0)
+        __blk_del(q, b);
+    q->size--;
+    return __u_out(e, sp, bufsize);
+}
+
+/*
+ * Attempt to remove element from tail of queue.
+ * Other attribute is as same as q_remove_head.
+ */
+element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
+{
+    if (!head || list_empty(head))
+        return NULL;
+    queue_t *q = __q_of(head);
+    block_t *b = __blk(head->prev);
+    uelem_t *e = b->slot[b->start + --b->count];
+    if (b->count == 0)
+        __blk_del(q, b);
+    q->size--;
+    return __u_out(e, sp, bufsize);
+}
+
+/*
+ * Attempt to remove up to n elements from head of queue, see queue_bulk.h.
+ * Whole windows are taken from the first blocks.
+ */
+int q_remove_head_bulk(struct list_head *head, int n, element_t **out)
+{
+    if (!head || n <= 0)
+        return 0;
+    queue_t *q = __q_of(head);
+    int k = 0;
+    while (k < n && !list_empty(head)) {
+        block_t *b = __blk(head->next);
+        int take = n - k < b->count ? n - k : b->count;
+        for (int i = 0; i < take; i++)
+            out[k++] = (element_t *) b->slot[b->start++];
+        b->count -= take;
+        if (b->count == 0)
+            __blk_del(q, b);
+    }
+    q->size -= k;
+    return k;
+}
+
+/*
+ * Remove the element at head or tail of queue and release it, returning its
+ * string as a block of its own. A string that was not adopted is duplicated
+ * first, so that failing to leaves the queue unchanged.
+ */
+static char *__u_take(struct list_head *head, bool tail)
+{
+    if (!head || list_empty(head))
+        return NULL;
+    block_t *b = __blk(tail ? head->prev : head->next);
+    uelem_t *e = b->slot[tail ? b->start + b->count - 1 : b->start];
+    char *s = e->value;
+    bool adopted = s != e->str && e->str[0] == STR_ADOPTED;
+    if (!adopted && !(s = strdup(s)))
+        return NULL;
+    if (tail)
+        q_remove_tail(head, NULL, 0);
+    else
+        q_remove_head(head, NULL, 0);
+    if (adopted)
+        slab_free(e);
+    else
+        __u_free(e);
+    return s;
+}
+
+/*
+ * Attempt to remove element from head of queue handing its string over, see
+ * queue_take.h
+ */
+char *q_remove_head_take(struct list_head *head)
+{
+    return __u_take(head, false);
+}
+
+/*
+ * Attempt to remove element from tail of queue handing its string over, see
+ * queue_take.h
+ */
+char *q_remove_tail_take(struct list_head *head)
+{
+    return __u_take(head, true);
+}
+
+/*
+ * WARN: This is for external usage, don't modify it
+ * Attempt to release element.
+ * The string lives in the same block as the value pointer (see __u_new),
+ * unless it was adopted (see __u_adopt).
+ */
+void q_release_element(element_t *e)
+{
+    __u_free((uelem_t *) e);
+}
+
+/*
+ * Return number of elements in queue.
+ * Return 0 if q is NULL or empty
+ */
+int q_size(struct list_head *head)
+{
+    if (!head)
+        return 0;
+    return __q_of(head)->size;
+}
+
+/*
+ * Delete the middle node in list.
+ * The middle node of a linked list of size n is the
+ * ⌊n / 2⌋th node from the start using 0-based indexing.
+ * Return false if list is NULL or empty.
+ *
+ * The walk to the middle counts whole blocks, so it visits one node per
+ * block rather than per element.
+ */
+bool q_delete_mid(struct list_head *head)
+{
+    if (!head || list_empty(head))
+        return false;
+    queue_t *q = __q_of(head);
+    int m = q->size / 2;
+
+    block_t *b;
+    list_for_each_entry (b, head, list) {
+        if (m < b->count)
+            break;
+        m -= b->count;
+    }
+    __u_free(__blk_take(q, b, b->start + m));
+    return true;
+}
+
+/*
+ * Delete all nodes that have duplicate string,
+ * leaving only distinct strings from the original list.
+ * Return true if successful.
+ * Return false if list is NULL or empty.
+ *
+ * Note: this function always be called after sorting, in other words,
+ * list is guaranteed to be sorted in ascending order.
+ */
+bool q_delete_dup(struct list_head *head)
+{
+    if (!head || list_empty(head))
+        return false;
+    queue_t *q = __q_of(head);
+    q_iter_t it = {.node = head};
+    uelem_t **first = __u_next_slot(head, &it), **cur;
+    bool dup = false;
+
+    // Clear the slots of deleted elements, then close the gaps at once
+    while ((cur = __u_next_slot(head, &it))) {
+        if (__u_same(*first, *cur)) {
+            __u_free(*cur);
+            *cur = NULL;
+            q->size--;
+            dup = true;
+            continue;
+        }
+        if (dup) {
+            __u_free(*first);
+            *first = NULL;
+            q->size--;
+            dup = false;
+        }
+        first = cur;
+    }
+    if (dup) {
+        __u_free(*first);
+        *first = NULL;
+        q->size--;
+    }
+
+    __u_compact(q);
+    return true;
+}
+
+/* Slot of the hash table behind q_delete_dup_unsorted */
+typedef struct {
+    uint64_t hash;
+    /* Queue slot of the first element seen with this value, NULL if empty */
+    uelem_t **slot;
+    bool dup;
+} __u_dedup_slot_t;
+
+/*
+ * Delete all nodes whose string occurs more than once, on a queue in any
+ * order, with the same open-addressing table as the list backend. Return
+ * false if queue is NULL or empty, or if the table could not be allocated,
+ * in which case the queue is left unchanged.
+ */
+bool q_delete_dup_unsorted(struct list_head *head)
+{
+    if (!head || list_empty(head))
+        return false;
+
+    queue_t *q = __q_of(head);
+    size_t cap = 2;
+    while (cap < 2 * (size_t) q->size)
+        cap <<= 1;
+    __u_dedup_slot_t *table = malloc(cap * sizeof(__u_dedup_slot_t));
+    if (!table)
+        return false;
+    memset(table, 0, cap * sizeof(__u_dedup_slot_t));
+
+    q_iter_t it = {.node = head};
+    uelem_t **cur;
+    while ((cur = __u_next_slot(head, &it))) {
+        uint64_t hash = __u_hash((*cur)->value);
+        size_t i = hash & (cap - 1);
+        while (table[i].slot &&
+               (table[i].hash != hash ||
+                strcmp((*table[i].slot)->value, (*cur)->value)))
+            i = (i + 1) & (cap - 1);
+
+        if (!table[i].slot) {
+            table[i].hash = hash;
+            table[i].slot = cur;
+            continue;
+        }
+        table[i].dup = true;
+        __u_free(*cur);
+        *cur = NULL;
+        q->size--;
+    }
+
+    for (size_t i = 0; i < cap; i++) {
+        if (!table[i].dup)
+            continue;
+        __u_free(*table[i].slot);
+        *table[i].slot = NULL;
+        q->size--;
+    }
+
+    free(table);
+    __u_compact(q);
+    return true;
+}
+
+/*
+ * Attempt to swap every two adjacent nodes.
+ */
+void q_swap(struct list_head *head)
+{
+    if (!head)
+        return;
+    q_iter_t it = {.node = head};
+    uelem_t **a, **b;
+    while ((a = __u_next_slot(head, &it)) && (b = __u_next_slot(head, &it))) {
+        uelem_t *tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+}
+
+/*
+ * Reverse elements in queue
+ * No effect if q is NULL or empty
+ * Blocks are relinked in reverse order and each window is reversed in
+ * place.
+ */
+void q_reverse(struct list_head *head)
+{
+    if (!head)
+        return;
+    struct list_head *node = head;
+    do {
+        struct list_head *next = node->next;
+        node->next = node->prev;
+        node->prev = next;
+        if (node != head) {
+            block_t *b = __blk(node);
+            for (int i = b->start, j = b->start + b->count - 1; i < j;
+                 i++, j--) {
+                uelem_t *tmp = b->slot[i];
+                b->slot[i] = b->slot[j];
+                b->slot[j] = tmp;
+            }
+        }
+        node = next;
+    } while (node != head);
+}
+
+/* Element and its key prefix, as sorted by q_sort */
+typedef struct {
+    uint64_t key;
+    uelem_t *e;
+} __u_item_t;
+
+/* Runs sorted by insertion before merging */
+#define SORT_RUN 16
+
+static inline int __u_cmp(const __u_item_t *a, const __u_item_t *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    // Equal keys with a zero last byte mean both strings ended early
+    if (!(a->key & 0xff))
+        return 0;
+    return strcmp(a->e->value + KEY_PREFIX_LEN, b->e->value + KEY_PREFIX_LEN);
+}
+
+/*
+ * Sort elements of queue in ascending order
+ * No effect if q is NULL or empty. In addition, if q has only one
+ * element, do nothing.
+ *
+ * The elements and their key prefixes are gathered into an array mapped
+ * from the kernel (qtest sorts in no-allocate mode), sorted there with a
+ * stable bottom-up merge sort, and written back into the same slots. Nothing
+ * happens if the array cannot be mapped.
+ */
+void q_sort(struct list_head *head)
+{
+    if (!head || list_empty(head))
+        return;
+    size_t n = __q_of(head)->size;
+    if (n < 2)
+        return;
+
+    size_t bytes = 2 * n * sizeof(__u_item_t);
+    __u_item_t *src = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (src == MAP_FAILED)
+        return;
+    __u_item_t *dst = src + n, *buf = src;
+
+    q_iter_t it = {.node = head};
+    uelem_t **slot;
+    for (size_t i = 0; (slot = __u_next_slot(head, &it)); i++) {
+        src[i].e = *slot;
+        src[i].key = __q_key((*slot)->value);
+    }
+
+    for (size_t lo = 0; lo < n; lo += SORT_RUN) {
+        size_t hi = lo + SORT_RUN < n ? lo + SORT_RUN : n;
+        for (size_t i = lo + 1; i < hi; i++) {
+            __u_item_t x = src[i];
+            size_t j = i;
+            for (; j > lo && __u_cmp(&x, &src[j - 1]) < 0; j--)
+                src[j] = src[j - 1];
+            src[j] = x;
+        }
+    }
+
+    for (size_t width = SORT_RUN; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, k = lo;
+            while (i < mid && j < hi)
+                dst[k++] = __u_cmp(&src[j], &src[i]) < 0 ? src[j++] : src[i++];
+            while (i < mid)
+                dst[k++] = src[i++];
+            while (j < hi)
+                dst[k++] = src[j++];
+        }
+        __u_item_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    it.node = head;
+    for (size_t i = 0; (slot = __u_next_slot(head, &it)); i++)
+        *slot = src[i].e;
+
+    munmap(buf, bytes);
+}
+
+/*
+ * Read position of a queue taking part in a merge, with the next element
+ * and its key prefix at hand for the matches of the loser tree
+ */
+typedef struct {
+    queue_t *q;
+    /* Block of the next element, NULL once the queue is exhausted */
+    block_t *b;
+    int i;
+    __u_item_t next;
+} __u_cursor_t;
+
+/*
+ * Load the element at the position of cursor c, if any
+ */
+static inline void __u_cursor_load(__u_cursor_t *c)
+{
+    if (!c->b)
+        return;
+    c->next.e = c->b->slot[c->i];
+    c->next.key = __q_key(c->next.e->value);
+}
+
+/*
+ * Point cursor c at the first element of its queue
+ */
+static inline void __u_cursor_first(__u_cursor_t *c)
+{
+    c->b = list_empty(&c->q->head) ? NULL : __blk(c->q->head.next);
+    c->i = c->b ? c->b->start : 0;
+    __u_cursor_load(c);
+}
+
+/*
+ * Step cursor c to the next element of its queue, moving the block left
+ * behind to pool
+ */
+static inline void __u_cursor_next(__u_cursor_t *c, struct list_head *pool)
+{
+    if (++c->i == c->b->start + c->b->count) {
+        block_t *done = c->b;
+        c->b = done->list.next == &c->q->head ? NULL : __blk(done->list.next);
+        c->i = c->b ? c->b->start : 0;
+        list_move(&done->list, pool);
+    }
+    __u_cursor_load(c);
+}
+
+/*
+ * Whether the next element of cursor a goes before the one of cursor b in
+ * a merge, ties going to the earlier queue. Exhausted cursors lose.
+ */
+static bool __u_merge_beats(void *ctx, int a, int b)
+{
+    __u_cursor_t *cur = ctx;
+    if (!cur[a].b)
+        return false;
+    if (!cur[b].b)
+        return true;
+    int cmp = __u_cmp(&cur[a].next, &cur[b].next);
+    return cmp < 0 || (cmp == 0 && a < b);
+}
+
+/*
+ * Merge sorted queues into the first one, see queue_merge.h, past
+ * LOSER_TREE_MAX queues in O(N k / LOSER_TREE_MAX) as stated there. The
+ * first queue and up to LOSER_TREE_MAX - 1 others are merged at each pass, into
+ * blocks taken from a pool that gets back every block a merged queue is
+ * done with. As k queues have left at most k blocks partly read, the pool
+ * never runs dry if it starts with LOSER_TREE_MAX blocks, allocated before
+ * anything moves.
+ */
+int q_merge(struct list_head *head)
+{
+    if (!head || list_empty(head))
+        return 0;
+
+    queue_context_t *first = list_first_entry(head, queue_context_t, chain);
+    if (!first->q)
+        return 0;
+    queue_t *fq = __q_of(first->q);
+
+    int total = 0;
+    queue_context_t *ctx;
+    list_for_each_entry (ctx, head, chain) {
+        if (ctx->q)
+            total += __q_of(ctx->q)->size;
+    }
+
+    LIST_HEAD(pool);
+    int reserve = (total + BLOCK_SLOTS - 1) / BLOCK_SLOTS;
+    if (reserve > LOSER_TREE_MAX)
+        reserve = LOSER_TREE_MAX;
+    for (int i = 0; i < reserve; i++) {
+        block_t *b = malloc(sizeof(block_t));
+        if (!b) {
+            while (!list_empty(&pool)) {
+                b = __blk(pool.next);
+                list_del(&b->list);
+                free(b);
+            }
+            return -1;
+        }
+        list_add(&b->list, &pool);
+    }
+
+    __u_cursor_t cur[LOSER_TREE_MAX];
+    int tree[LOSER_TREE_MAX];
+    struct list_head *pos = first->chain.next;
+    while (pos != head) {
+        int k = 0;
+        cur[k++].q = fq;
+        for (; pos != head && k < LOSER_TREE_MAX; pos = pos->next) {
+            ctx = list_entry(pos, queue_context_t, chain);
+            if (ctx->q && !list_empty(ctx->q))
+                cur[k++].q = __q_of(ctx->q);
+            ctx->size = 0;
+        }
+        for (int i = 0; i < k; i++)
+            __u_cursor_first(&cur[i]);
+
+        LIST_HEAD(merged);
+        block_t *out = NULL;
+        int n = 0;
+        loser_tree_build(tree, k, __u_merge_beats, cur);
+        while (cur[tree[0]].b) {
+            int w = tree[0];
+            if (!out || out->count == BLOCK_SLOTS) {
+                out = __blk(pool.next);
+                list_move_tail(&out->list, &merged);
+                out->start = 0;
+                out->count = 0;
+            }
+            out->slot[out->count++] = cur[w].next.e;
+            n++;
+            __u_cursor_next(&cur[w], &pool);
+            loser_tree_replay(tree, k, w, __u_merge_beats, cur);
+        }
+
+        for (int i = 0; i < k; i++)
+            cur[i].q->size = 0;
+        list_splice(&merged, &fq->head);
+        fq->size = n;
+    }
+
+    while (!list_empty(&pool)) {
+        block_t *b = __blk(pool.next);
+        list_del(&b->list);
+        if (fq->spare)
+            free(b);
+        else
+            fq->spare = b;
+    }
+    first->size = fq->size;
+    return first->size;
+}
+
+/*
+ * Find the first element after string s, or not before it unless after is
+ * set: the blocks are skipped over by their last element, then the slot is
+ * found by binary search. Return its block and store its slot to *pos, or
+ * return NULL if every element goes before.
+ */
+static block_t *__u_seek(struct list_head *head,
+                         const char *s,
+                         bool after,
+                         int *pos)
+{
+    block_t *b;
+    list_for_each_entry (b, head, list) {
+        int cmp = strcmp(b->slot[b->start + b->count - 1]->value, s);
+        if (cmp > 0 || (!after && cmp == 0))
+            break;
+    }
+    if (&b->list == head)
+        return NULL;
+
+    int lo = b->start, hi = b->start + b->count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(b->slot[mid]->value, s);
+        if (cmp < 0 || (after && cmp == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *pos = lo;
+    return b;
+}
+
+/*
+ * Attempt to insert a copy of s at its place in the queue, see
+ * queue_sorted.h. The walk to its block visits one node per block.
+ */
+bool q_insert_sorted(struct list_head *head, char *s)
+{
+    if (!head)
+        return false;
+    uelem_t *e = __u_new(s);
+    if (!e)
+        return false;
+
+    int pos;
+    block_t *b = __u_seek(head, s, true, &pos);
+    if (!b)
+        return __u_add_tail(head, e);
+    if (!__blk_insert(__q_of(head), b, pos, e)) {
+        __u_free(e);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Look up an element equal to s, see queue_sorted.h
+ */
+char *q_find_sorted(struct list_head *head, const char *s)
+{
+    int pos;
+    block_t *b = head ? __u_seek(head, s, false, &pos) : NULL;
+    if (!b || strcmp(b->slot[pos]->value, s))
+        return NULL;
+    return b->slot[pos]->value;
+}
+
+/*
+ * Delete the first element equal to s, see queue_sorted.h
+ */
+bool q_delete_sorted(struct list_head *head, const char *s)
+{
+    int pos;
+    block_t *b = head ? __u_seek(head, s, false, &pos) : NULL;
+    if (!b || strcmp(b->slot[pos]->value, s))
+        return false;
+    __u_free(__blk_take(__q_of(head), b, pos));
+    return true;
+}
+
+/* State of the splitmix64 generator behind q_shuffle, 0 until seeded */
+static uint64_t shuffle_state = 0;
+
+/*
+ * Seed the shuffle PRNG, making q_shuffle reproducible
+ */
+void q_shuffle_seed(uint64_t seed)
+{
+    shuffle_state = seed ? seed : 1;
+}
+
+/*
+ * splitmix64, as in queue.c
+ */
+static uint64_t __q_rand()
+{
+    uint64_t z = (shuffle_state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/*
+ * Unbiased random integer in [0, bound), as in queue.c
+ */
+static uint64_t __q_rand_below(uint64_t bound)
+{
+    __uint128_t m = (__uint128_t) __q_rand() * bound;
+    uint64_t low = (uint64_t) m;
+    if (low < bound) {
+        uint64_t threshold = -bound % bound;
+        while (low < threshold) {
+            m = (__uint128_t) __q_rand() * bound;
+            low = (uint64_t) m;
+        }
+    }
+    return m >> 64;
+}
+
+/*
+ * Fisher–Yates shuffle over an array of the elements mapped from the
+ * kernel, written back into the same slots. Nothing happens if the array
+ * cannot be mapped.
+ */
+void q_shuffle(struct list_head *head)
+{
+    if (!head || list_empty(head))
+        return;
+    size_t n = __q_of(head)->size;
+    if (n < 2)
+        return;
+
+    size_t bytes = n * sizeof(uelem_t *);
+    uelem_t **array = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (array == MAP_FAILED)
+        return;
+
+    q_iter_t it = {.node = head};
+    uelem_t **slot;
+    for (size_t i = 0; (slot = __u_next_slot(head, &it)); i++)
+        array[i] = *slot;
+
+    if (!shuffle_state)
+        q_shuffle_seed(((uint64_t) rand() << 32) ^ rand());
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = __q_rand_below(i + 1);
+        uelem_t *tmp = array[i];
+        array[i] = array[j];
+        array[j] = tmp;
+    }
+
+    it.node = head;
+    for (size_t i = 0; (slot = __u_next_slot(head, &it)); i++)
+        *slot = array[i];
+
+    munmap(array, bytes);
+}
+
+/*
+ * Cursor over queue elements, see queue_iter.h. The cursor is a block and
+ * a slot within it.
+ */
+char *q_iter_first(struct list_head *head, q_iter_t *it)
+{
+    if (!head)
+        return NULL;
+    it->node = head;
+    return q_iter_next(head, it);
+}
+
+char *q_iter_last(struct list_head *head, q_iter_t *it)
+{
+    if (!head || list_empty(head))
+        return NULL;
+    block_t *b = __blk(head->prev);
+    it->node = head->prev;
+    it->idx = b->start + b->count - 1;
+    return b->slot[it->idx]->value;
+}
+
+char *q_iter_next(struct list_head *head, q_iter_t *it)
+{
+    uelem_t **slot = __u_next_slot(head, it);
+    return slot ? (*slot)->value : NULL;
+}
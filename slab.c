@@ -0,0 +1,305 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "list.h"
+#include "slab.h"
+
+/* Value at start of every live object allocated in checked mode */
+#define OBJ_MAGIC_CHECKED 0xdeadc0de
+
+/* Value at start of every live object allocated without checks */
+#define OBJ_MAGIC 0xc0dec0de
+
+/* Value when object is released */
+#define OBJ_MAGIC_FREE 0xffffffff
+
+/* Value placed right after the payload in checked mode */
+#define OBJ_MAGIC_FOOTER 0xc0dedead
+
+/* Byte to fill released payload with in checked mode */
+#define OBJ_FILLCHAR 0x55
+
+/* Bytes requested from malloc for each slab */
+#define SLAB_BYTES (64 * 1024)
+
+/* Slots are kept aligned to this boundary */
+#define SLAB_ALIGN 16
+
+#define ALIGN_UP(x, a) (((x) + (a) -1) & ~((uintptr_t) (a) -1))
+
+int slab_mode = SLAB_OFF;
+
+struct slab;
+
+/* Prepended to every object, whether it lives in a slab or not */
+typedef struct {
+    struct slab *slab; /* owning slab, NULL for a separate malloc block */
+    uint32_t magic;
+    uint32_t size; /* requested payload size */
+} obj_header_t;
+
+typedef struct {
+    size_t slot_size;
+    /* Slabs with at least one free slot, the spare empty slab included */
+    struct list_head partial;
+    /* Slabs without any free slot */
+    struct list_head full;
+    size_t nempty;
+} slab_class_t;
+
+/* A slab of a size class, or an arena when cls is NULL */
+typedef struct slab {
+    struct list_head list;
+    slab_class_t *cls;
+    char *free; /* singly-linked list of recycled slots */
+    char *bump; /* first slot never handed out so far */
+    char *end;
+    size_t inuse;
+} slab_t;
+
+#define DEFINE_CLASS(sz)                                                 \
+    {                                                                    \
+        .slot_size = (sz), .partial = {NULL, NULL}, .full = {NULL, NULL} \
+    }
+
+static slab_class_t classes[] = {
+    DEFINE_CLASS(32),   DEFINE_CLASS(48),   DEFINE_CLASS(64),
+    DEFINE_CLASS(96),   DEFINE_CLASS(128),  DEFINE_CLASS(192),
+    DEFINE_CLASS(256),  DEFINE_CLASS(512),  DEFINE_CLASS(1024),
+    DEFINE_CLASS(2048), DEFINE_CLASS(4096),
+};
+
+#define NR_CLASSES (sizeof(classes) / sizeof(classes[0]))
+
+/* Objects currently handed out from slabs */
+static size_t live_count = 0;
+static size_t slabs_held = 0;
+
+static inline void put_footer(obj_header_t *hdr)
+{
+    uint32_t footer = OBJ_MAGIC_FOOTER;
+    memcpy((char *) (hdr + 1) + hdr->size, &footer, sizeof(footer));
+}
+
+static inline bool footer_ok(obj_header_t *hdr)
+{
+    uint32_t footer;
+    memcpy(&footer, (char *) (hdr + 1) + hdr->size, sizeof(footer));
+    return footer == OBJ_MAGIC_FOOTER;
+}
+
+/* Bytes of slot needed to hold a payload of the given size */
+static inline size_t slot_need(size_t size)
+{
+    return sizeof(obj_header_t) + size + sizeof(uint32_t);
+}
+
+static slab_class_t *find_class(size_t size)
+{
+    size_t need = slot_need(size);
+    for (size_t i = 0; i < NR_CLASSES; i++) {
+        if (classes[i].slot_size >= need)
+            return &classes[i];
+    }
+    return NULL;
+}
+
+static void init_classes()
+{
+    for (size_t i = 0; i < NR_CLASSES; i++) {
+        INIT_LIST_HEAD(&classes[i].partial);
+        INIT_LIST_HEAD(&classes[i].full);
+        classes[i].nempty = 0;
+    }
+}
+
+static slab_t *slab_new(slab_class_t *cls)
+{
+    slab_t *slab = malloc(SLAB_BYTES);
+    if (!slab)
+        return NULL;
+    slab->cls = cls;
+    slab->free = NULL;
+    slab->bump = (char *) ALIGN_UP((uintptr_t) (slab + 1), SLAB_ALIGN);
+    slab->end = (char *) slab + SLAB_BYTES;
+    slab->inuse = 0;
+    list_add(&slab->list, &cls->partial);
+    cls->nempty++;
+    slabs_held++;
+    return slab;
+}
+
+static void slab_release(slab_t *slab)
+{
+    list_del(&slab->list);
+    slab->cls->nempty--;
+    slabs_held--;
+    free(slab);
+}
+
+/* Hand every slab back once no object is live anymore */
+static void slab_drain()
+{
+    for (size_t i = 0; i < NR_CLASSES; i++) {
+        slab_t *slab, *safe;
+        list_for_each_entry_safe (slab, safe, &classes[i].partial, list)
+            slab_release(slab);
+    }
+}
+
+static obj_header_t *slot_take(slab_t *slab)
+{
+    char *slot;
+    if (slab->free) {
+        slot = slab->free;
+        memcpy(&slab->free, slot + sizeof(obj_header_t), sizeof(char *));
+    } else {
+        slot = slab->bump;
+        slab->bump += slab->cls->slot_size;
+    }
+
+    if (slab->inuse++ == 0)
+        slab->cls->nempty--;
+    if (!slab->free && slab->bump + slab->cls->slot_size > slab->end)
+        list_move(&slab->list, &slab->cls->full);
+    return (obj_header_t *) slot;
+}
+
+static void slot_give(slab_t *slab, obj_header_t *hdr)
+{
+    slab_class_t *cls = slab->cls;
+    bool was_full = !slab->free && slab->bump + cls->slot_size > slab->end;
+
+    memcpy((char *) (hdr + 1), &slab->free, sizeof(char *));
+    slab->free = (char *) hdr;
+    if (was_full)
+        list_move(&slab->list, &cls->partial);
+
+    if (--slab->inuse == 0) {
+        cls->nempty++;
+        /* Keep a single spare per class to absorb insert/remove churn */
+        if (cls->nempty > 1)
+            slab_release(slab);
+    }
+    if (--live_count == 0)
+        slab_drain();
+}
+
+void *slab_alloc(size_t size)
+{
+    obj_header_t *hdr;
+    slab_class_t *cls = slab_mode == SLAB_OFF ? NULL : find_class(size);
+
+    if (!cls) {
+        hdr = malloc(sizeof(obj_header_t) + size);
+        if (!hdr)
+            return NULL;
+        hdr->slab = NULL;
+        hdr->magic = OBJ_MAGIC;
+        hdr->size = size;
+        return hdr + 1;
+    }
+
+    if (!cls->partial.next)
+        init_classes();
+
+    slab_t *slab;
+    if (list_empty(&cls->partial)) {
+        slab = slab_new(cls);
+        if (!slab)
+            return NULL;
+    } else {
+        slab = list_first_entry(&cls->partial, slab_t, list);
+    }
+
+    hdr = slot_take(slab);
+    live_count++;
+    hdr->slab = slab;
+    hdr->size = size;
+    if (slab_mode == SLAB_CHECKED) {
+        hdr->magic = OBJ_MAGIC_CHECKED;
+        put_footer(hdr);
+    } else {
+        hdr->magic = OBJ_MAGIC;
+    }
+    return hdr + 1;
+}
+
+void slab_free(void *p)
+{
+    if (!p)
+        return;
+
+    obj_header_t *hdr = (obj_header_t *) p - 1;
+    if (hdr->magic == OBJ_MAGIC_CHECKED) {
+        if (!footer_ok(hdr)) {
+            test_alloc_error(
+                "Corruption detected in slab object when attempting to free "
+                "it",
+                p);
+        }
+        memset(p, OBJ_FILLCHAR, hdr->size);
+    } else if (hdr->magic != OBJ_MAGIC) {
+        test_alloc_error(
+            "Attempted to free unallocated or corrupted slab object", p);
+        return;
+    }
+    hdr->magic = OBJ_MAGIC_FREE;
+
+    if (!hdr->slab) {
+        free(hdr);
+        return;
+    }
+    if (!hdr->slab->cls) {
+        if (--hdr->slab->inuse == 0)
+            free(hdr->slab);
+        return;
+    }
+    slot_give(hdr->slab, hdr);
+}
+
+size_t slab_count()
+{
+    return slabs_held;
+}
+
+size_t slab_arena_size(size_t size)
+{
+    return ALIGN_UP(slot_need(size), SLAB_ALIGN);
+}
+
+slab_arena_t *slab_arena_new(size_t bytes)
+{
+    size_t start = ALIGN_UP(sizeof(slab_t), SLAB_ALIGN);
+    slab_t *arena = malloc(start + bytes);
+    if (!arena)
+        return NULL;
+    arena->cls = NULL;
+    arena->free = NULL;
+    arena->bump = (char *) arena + start;
+    arena->end = arena->bump + bytes;
+    arena->inuse = 0;
+    return arena;
+}
+
+void *slab_arena_alloc(slab_arena_t *arena, size_t size)
+{
+    size_t need = slab_arena_size(size);
+    if (need > (size_t) (arena->end - arena->bump))
+        return NULL;
+
+    obj_header_t *hdr = (obj_header_t *) arena->bump;
+    arena->bump += need;
+    arena->inuse++;
+    hdr->slab = arena;
+    hdr->size = size;
+    if (slab_mode == SLAB_CHECKED) {
+        hdr->magic = OBJ_MAGIC_CHECKED;
+        put_footer(hdr);
+    } else {
+        hdr->magic = OBJ_MAGIC;
+    }
+    return hdr + 1;
+}
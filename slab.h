@@ -0,0 +1,67 @@
+#ifndef LAB0_SLAB_H
+#define LAB0_SLAB_H
+
+/*
+ * Size-class slab pool for queue elements.
+ *
+ * Objects are carved out of large slabs obtained from malloc, so under the
+ * test harness every slab is one tracked block. Freed objects are recycled
+ * through a per-slab free list, and a slab is handed back to free once it
+ * has no live object left (one empty slab per class is kept as a spare while
+ * the pool is in use). As a result allocation_check() still counts leaked
+ * elements, at slab granularity, as soon as every queue has been freed.
+ */
+
+#include <stddef.h>
+
+/* Pool modes, selected through slab_mode */
+enum {
+    SLAB_OFF = 0,     /* every object is a separate malloc block */
+    SLAB_CHECKED = 1, /* slab pool with per-object magic header/footer */
+    SLAB_FAST = 2,    /* slab pool without integrity checks */
+};
+
+/* Current pool mode, may be changed at any time */
+extern int slab_mode;
+
+/*
+ * Allocate an object of the given size.
+ * Return NULL if could not allocate space.
+ */
+void *slab_alloc(size_t size);
+
+/*
+ * Release an object returned by slab_alloc, whatever mode it came from.
+ * No effect if p is NULL.
+ */
+void slab_free(void *p);
+
+/* Number of slabs currently held by the pool */
+size_t slab_count();
+
+/*
+ * Arena: a single block carved into objects of any size, for a batch of
+ * objects allocated at once. Whatever slab_mode says, every object gets the
+ * same header as the others and is released on its own with slab_free().
+ * The block is handed back to free once all its objects are, so a single
+ * object kept alive holds the whole block.
+ */
+typedef struct slab slab_arena_t;
+
+/* Bytes taken in an arena by an object of the given size */
+size_t slab_arena_size(size_t size);
+
+/*
+ * Allocate an arena of the given number of bytes, as added up with
+ * slab_arena_size(). At least one object must be carved out of it.
+ * Return NULL if could not allocate space.
+ */
+slab_arena_t *slab_arena_new(size_t bytes);
+
+/*
+ * Carve an object of the given size out of the arena.
+ * Return NULL if the arena has no room left for it.
+ */
+void *slab_arena_alloc(slab_arena_t *arena, size_t size);
+
+#endif /* LAB0_SLAB_H */
@@ -0,0 +1,123 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "harness.h"
+#include "spsc.h"
+
+/* Size of a cache line, the unit of false sharing between the two sides */
+#define CACHE_LINE 64
+
+/*
+ * Queue state, split into groups written by one side only.
+ *
+ * Strings occupy slot[head & mask] up to slot[(tail - 1) & mask], indices
+ * counting up without wrapping. Each side moves a private copy of its index
+ * and stores the shared one every batch steps, or when it is about to wait
+ * for the other side. Each group is followed by a full cache line of
+ * padding rather than aligned, since the descriptor comes from malloc, so no
+ * line holds fields of both sides whatever the base alignment.
+ */
+struct spsc {
+    /* Read-only after spsc_new */
+    char **slot;
+    size_t mask;
+    size_t batch;
+    char __pad0[CACHE_LINE];
+
+    /* Producer side */
+    atomic_size_t tail; /* published end, read by the consumer */
+    size_t pending;     /* end including unpublished pushes */
+    size_t head_cache;  /* last value of head seen */
+    char __pad1[CACHE_LINE];
+
+    /* Consumer side */
+    atomic_size_t head; /* released start, read by the producer */
+    size_t next;        /* next slot to read */
+    size_t tail_cache;  /* last value of tail seen */
+    char __pad2[CACHE_LINE];
+};
+
+spsc_t *spsc_new(size_t capacity, size_t batch)
+{
+    size_t cap = 2;
+    while (cap < capacity)
+        cap <<= 1;
+
+    spsc_t *q = malloc(sizeof(spsc_t));
+    if (!q)
+        return NULL;
+    q->slot = malloc(cap * sizeof(char *));
+    if (!q->slot) {
+        free(q);
+        return NULL;
+    }
+    q->mask = cap - 1;
+    q->batch = batch ? (batch < cap ? batch : cap) : 1;
+    atomic_init(&q->tail, 0);
+    q->pending = 0;
+    q->head_cache = 0;
+    atomic_init(&q->head, 0);
+    q->next = 0;
+    q->tail_cache = 0;
+    return q;
+}
+
+void spsc_free(spsc_t *q)
+{
+    if (!q)
+        return;
+    free(q->slot);
+    free(q);
+}
+
+void spsc_flush(spsc_t *q)
+{
+    // Release: the slots written so far are visible before the new tail
+    atomic_store_explicit(&q->tail, q->pending, memory_order_release);
+}
+
+bool spsc_push(spsc_t *q, char *s)
+{
+    if (q->pending - q->head_cache > q->mask) {
+        // Acquire: the consumer is done with the slots it has released
+        q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (q->pending - q->head_cache > q->mask) {
+            spsc_flush(q);
+            return false;
+        }
+    }
+
+    q->slot[q->pending++ & q->mask] = s;
+    if (q->pending - atomic_load_explicit(&q->tail, memory_order_relaxed) >=
+        q->batch)
+        spsc_flush(q);
+    return true;
+}
+
+/*
+ * Consumer: hand the slots read so far back to the producer
+ */
+static inline void __spsc_release(spsc_t *q)
+{
+    // Release: the slots are read before the producer may overwrite them
+    atomic_store_explicit(&q->head, q->next, memory_order_release);
+}
+
+char *spsc_pop(spsc_t *q)
+{
+    if (q->next == q->tail_cache) {
+        // Acquire: pairs with the release in spsc_flush
+        q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (q->next == q->tail_cache) {
+            __spsc_release(q);
+            return NULL;
+        }
+    }
+
+    char *s = q->slot[q->next++ & q->mask];
+    if (q->next - atomic_load_explicit(&q->head, memory_order_relaxed) >=
+        q->batch)
+        __spsc_release(q);
+    return s;
+}
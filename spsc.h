@@ -0,0 +1,51 @@
+#ifndef LAB0_SPSC_H
+#define LAB0_SPSC_H
+
+/*
+ * Lock-free single-producer/single-consumer queue of strings.
+ *
+ * Hands strings from one thread to another without a mutex: only the
+ * producer calls spsc_push() and spsc_flush(), only the consumer calls
+ * spsc_pop(). The queue holds pointers and never copies strings, so
+ * ownership of a string passes to the consumer with it.
+ *
+ * The producer publishes its writes every `batch` pushes and the consumer
+ * hands slots back every `batch` pops, and each side only reads the index
+ * of the other once it runs out of room or of strings, so the cache lines
+ * holding the indices change hands about once per batch rather than once
+ * per string. A producer that stops pushing must call spsc_flush() for the
+ * last strings to become visible.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct spsc spsc_t;
+
+/*
+ * Create an empty queue holding up to capacity strings (rounded up to a
+ * power of two), published every batch pushes.
+ * Return NULL if could not allocate space.
+ */
+spsc_t *spsc_new(size_t capacity, size_t batch);
+
+/* Free the queue, but not the strings left in it. No effect if q is NULL */
+void spsc_free(spsc_t *q);
+
+/*
+ * Producer: append s to the queue.
+ * Return false if the queue is full, in which case pending pushes are
+ * published so that the consumer can make room.
+ */
+bool spsc_push(spsc_t *q, char *s);
+
+/* Producer: publish every string pushed so far */
+void spsc_flush(spsc_t *q);
+
+/*
+ * Consumer: take the oldest published string.
+ * Return NULL if none is available.
+ */
+char *spsc_pop(spsc_t *q);
+
+#endif /* LAB0_SPSC_H */
@@ -0,0 +1,21 @@
+# Benchmark of queue backends: build with `make QUEUE=<backend>` and compare
+# traversal (size check, show), sort and dedup on the same input
+# Run with: ./qtest -v 1 -f traces/bench-backend.cmd
+option fail 0
+option malloc 0
+option timelimit 60
+option slab 2
+option seed 1
+new
+ih RAND 1000000
+time size 20
+time show
+time sort
+time show
+time reverse
+time shuffle
+time dm 100
+time sort
+time dedup
+time swap
+free
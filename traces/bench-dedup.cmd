@@ -0,0 +1,20 @@
+# Benchmark of dedup on random input: sort followed by the merge-based
+# dedup, against the hash-based dedup that keeps the queue order
+# Run with: ./qtest -v 1 -f traces/bench-dedup.cmd
+option fail 0
+option malloc 0
+option timelimit 60
+option slab 2
+new
+ih RAND 1000000
+it aardvark 1000
+ih RAND 1000000
+time sort
+time dedup
+free
+new
+ih RAND 1000000
+it aardvark 1000
+ih RAND 1000000
+time dedup hash
+free
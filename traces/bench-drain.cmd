@@ -0,0 +1,11 @@
+# Benchmark of draining a queue in batches with rhq n
+# Run with: ./qtest -v 1 -f traces/bench-drain.cmd
+option fail 0
+option malloc 0
+option slab 2
+new
+it dolphin 1000000
+time rhq 1000000
+ih RAND 1000000
+time rhq 1000000
+free
@@ -0,0 +1,29 @@
+# Benchmark of the two-ended list walk on shuffled lists of 1M to
+# 10M nodes, cold in the cache: time of shuffle and of the hash dedup,
+# which walk the queue from both ends at once, and of free, which does not
+# Run with: ./qtest -v 1 -f traces/bench-ends.cmd
+option fail 0
+option malloc 0
+option slab 2
+option timelimit 60
+new
+it RAND 1000000
+shuffle
+time
+time shuffle
+time dedup hash
+time free
+new
+it RAND 4000000
+shuffle
+time
+time shuffle
+time dedup hash
+time free
+new
+it RAND 10000000
+shuffle
+time
+time shuffle
+time dedup hash
+time free
@@ -0,0 +1,49 @@
+# Benchmark of the sort engines over 1K to 1M random strings: comparisons
+# and time of list_sort in list.h (bottom-up) against the recursive
+# __mergesort (top-down) of queue.c
+# Run with: ./qtest -v 1 -f traces/bench-listsort.cmd
+option fail 0
+option malloc 0
+option sortstats 1
+option timelimit 10
+option sort 0
+new
+it RAND 1000
+sort
+option sort 1
+new
+it RAND 1000
+sort
+option sort 0
+new
+it RAND 1024
+sort
+option sort 1
+new
+it RAND 1024
+sort
+option sort 0
+new
+it RAND 10000
+sort
+option sort 1
+new
+it RAND 10000
+sort
+option sort 0
+new
+it RAND 100000
+sort
+option sort 1
+new
+it RAND 100000
+sort
+option sort 0
+new
+it RAND 1000000
+sort
+option sort 1
+new
+it RAND 1000000
+sort
+free
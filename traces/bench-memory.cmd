@@ -0,0 +1,11 @@
+# Memory taken per element by a queue backend: build with
+# `make QUEUE=<backend>` and compare, for 1M short random strings
+# Run with: ./qtest -v 1 -f traces/bench-memory.cmd
+option fail 0
+option malloc 0
+option timelimit 60
+option seed 1
+new
+ih RAND 1000000
+mem
+free
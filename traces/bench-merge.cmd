@@ -0,0 +1,516 @@
+# Benchmark of q_merge against sorting the concatenated queues, for 1M
+# random strings spread over 4, 16 and 64 sorted queues
+# Run with: ./qtest -v 1 -f traces/bench-merge.cmd
+option fail 0
+option malloc 0
+new
+it RAND 262144
+sort
+chain
+it RAND 262144
+sort
+chain
+it RAND 262144
+sort
+chain
+it RAND 262144
+sort
+merge
+new
+it RAND 262144
+sort
+chain
+it RAND 262144
+sort
+chain
+it RAND 262144
+sort
+chain
+it RAND 262144
+sort
+merge sort
+new
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+merge
+new
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+chain
+it RAND 65536
+sort
+merge sort
+new
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+merge
+new
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+chain
+it RAND 16384
+sort
+merge sort
+free
@@ -0,0 +1,15 @@
+# Benchmark of repeated median deletion, walking to the middle node every
+# time and then with the middle cursor
+# Run with: ./qtest -v 1 -f traces/bench-mid.cmd
+option fail 0
+option malloc 0
+option timelimit 60
+option slab 2
+new
+ih RAND 1000000
+option midcursor 0
+time dm 500
+option midcursor 1
+time dm 500
+time dm 500000
+free
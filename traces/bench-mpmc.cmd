@@ -0,0 +1,9 @@
+# Benchmark of the lock-free multi-producer/multi-consumer queue, from one
+# thread up to the number of cores
+# Run with: ./qtest -v 1 -f traces/bench-mpmc.cmd
+option fail 0
+option malloc 0
+option slab 2
+mpmc 2000000
+option mpmcthreads 8
+mpmc 2000000
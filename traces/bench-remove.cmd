@@ -0,0 +1,12 @@
+# Benchmark of removals copying the string out, with buffers of 16 to 8192
+# bytes: the cost per removal should not depend on the buffer size
+# Run with: ./qtest -v 1 -f traces/bench-remove.cmd
+option fail 0
+option malloc 0
+option slab 2
+new
+it dolphin 1000000
+rhcost
+ih RAND 1000000
+rhcost
+free
@@ -0,0 +1,17 @@
+# Benchmark of shuffle on large queues
+# Run with: ./qtest -v 1 -f traces/bench-shuffle.cmd
+option fail 0
+option malloc 0
+option timelimit 60
+option slab 2
+option seed 1
+new
+ih RAND 1000000
+time shuffle
+time shuffle
+free
+new
+ih RAND 10000000
+time shuffle
+time shuffle
+free
@@ -0,0 +1,117 @@
+# Benchmark of sort engines on random input, then on sorted and
+# reverse-sorted input as trace-15-perf does, then of the parallel sort
+# with an increasing number of threads.
+# Run with: ./qtest -v 1 -f traces/bench-sort.cmd
+option fail 0
+option malloc 0
+option timelimit 60
+option slab 2
+new
+ih RAND 100000
+option sort 1
+time sort
+reverse
+time sort
+free
+new
+ih RAND 100000
+option sort 0
+time sort
+reverse
+time sort
+free
+new
+ih RAND 100000
+option sort 2
+time sort
+reverse
+time sort
+free
+new
+ih RAND 100000
+option sort 3
+time sort
+reverse
+time sort
+free
+new
+ih RAND 1000000
+option sort 1
+time sort
+reverse
+time sort
+free
+new
+ih RAND 1000000
+option sort 0
+time sort
+reverse
+time sort
+free
+new
+ih RAND 1000000
+option sort 2
+time sort
+reverse
+time sort
+free
+new
+ih RAND 1000000
+option sort 3
+time sort
+reverse
+time sort
+free
+new
+ih RAND 10000000
+option sort 1
+time sort
+reverse
+time sort
+free
+new
+ih RAND 10000000
+option sort 0
+time sort
+reverse
+time sort
+free
+new
+ih RAND 10000000
+option sort 2
+time sort
+reverse
+time sort
+free
+new
+ih RAND 10000000
+option sort 3
+time sort
+reverse
+time sort
+free
+new
+ih RAND 10000000
+option sort 2
+option threads 1
+time sort
+free
+new
+ih RAND 10000000
+option sort 2
+option threads 2
+time sort
+free
+new
+ih RAND 10000000
+option sort 2
+option threads 4
+time sort
+free
+new
+ih RAND 10000000
+option sort 2
+option threads 8
+time sort
+free
+option threads 1
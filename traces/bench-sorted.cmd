@@ -0,0 +1,24 @@
+# Benchmark of inserts keeping 100K random strings sorted: appending and
+# sorting again after each one, then inserting each at its place. Strings
+# appended are only on level 0 of the skip list of the list backend, so its
+# first inserts walk much of the list, and 10K more show the levels filling
+# Run with: ./qtest -v 1 -f traces/bench-sorted.cmd
+option fail 0
+option malloc 0
+option timelimit 60
+new
+it RAND 100000
+sort
+time it RAND
+time sort
+time it RAND
+time sort
+time it RAND
+time sort
+time is RAND
+time is RAND
+time is RAND
+time is RAND 10000
+time find kiwi
+time ds kiwi
+free
@@ -0,0 +1,13 @@
+# Benchmark of the lock-free single-producer/single-consumer queue against
+# the mutex-guarded list, one producer and one consumer thread
+# Run with: ./qtest -v 1 -f traces/bench-spsc.cmd
+option fail 0
+option malloc 0
+option slab 2
+option spsccap 1024
+option spscbatch 1
+spsc 5000000
+option spscbatch 32
+spsc 5000000
+option spsccap 65536
+spsc 5000000
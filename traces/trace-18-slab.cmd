@@ -0,0 +1,30 @@
+# Test of queue operations with elements served from the slab pool
+option fail 0
+option malloc 0
+option slab 1
+new
+ih RAND 3000
+it gerbil 3000
+rh
+rt gerbil
+size
+dm
+sort
+dedup
+reverse
+free
+new
+option malloc 25
+option fail 30
+ih dolphin 20
+it bear 20
+free
+option malloc 0
+option slab 2
+new
+ih jaguar 5000
+rh jaguar
+option slab 0
+it meerkat 10
+rt meerkat
+free
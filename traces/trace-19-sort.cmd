@@ -0,0 +1,48 @@
+# Test of every sort engine on random, duplicated and presorted input,
+# sequentially and on worker threads
+option fail 0
+option malloc 0
+new
+option sort 0
+ih RAND 2000
+it gerbil 300
+ih dolphin 300
+sort
+reverse
+sort
+option sort 1
+ih RAND 2000
+sort
+reverse
+sort
+option sort 2
+ih RAND 2000
+it aardvark 100
+sort
+reverse
+sort
+option sort 3
+ih RAND 2000
+it zebra 100
+ih bear 100
+it aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa 70
+it aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab 70
+sort
+reverse
+sort
+dedup
+free
+new
+option sort 2
+option threads 4
+ih RAND 30000
+it gerbil 2000
+sort
+reverse
+sort
+option sort 3
+option threads 3
+ih RAND 20000
+sort
+option threads 1
+free
@@ -0,0 +1,22 @@
+# Test of shuffle on small and large queues, seeded and unseeded
+option fail 0
+option malloc 0
+new
+shuffle
+ih a
+shuffle
+it b
+it c
+it d
+it e
+option seed 42
+shuffle
+sort
+free
+new
+ih RAND 100000
+shuffle
+sort
+shuffle
+size
+free
@@ -0,0 +1,39 @@
+# Test of dedup on unsorted queues with the hash table, including
+# allocation failures of the table
+option fail 0
+option malloc 0
+new
+ih b
+dedup hash
+it a
+it c
+it b
+it a
+it d
+it e
+it d
+it d
+dedup hash
+free
+new
+ih RAND 5000
+it gerbil 50
+ih RAND 5000
+ih dolphin 2
+it RAND 5000
+dedup hash
+dedup hash
+size
+free
+option fail 10
+new
+ih a
+ih b
+ih a
+ih c
+option malloc 50
+dedup hash
+dedup hash
+dedup hash
+option malloc 0
+free
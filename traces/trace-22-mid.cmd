@@ -0,0 +1,69 @@
+# Test of delete middle with the cached middle cursor, kept across inserts
+# and removes on both ends and recomputed after reordering operations
+option fail 0
+option malloc 0
+new
+ih a
+dm
+it b
+ih c
+it d
+it e
+ih f
+dm
+rh
+rt
+dm
+ih g 5
+it h 4
+dm 3
+reverse
+dm
+swap
+dm
+it i 7
+ih j 2
+reverse
+dm 2
+swap
+rh
+dm
+sort
+dm
+it a 3
+ih z 3
+sort
+dedup
+dm
+it k 6
+ih l 5
+it m
+dedup hash
+ih n 9
+dm 2
+shuffle
+dm
+option midcursor 0
+dm
+swap
+dm
+option midcursor 1
+dm 3
+size
+free
+new
+ih RAND 5000
+dm 100
+reverse
+dm 100
+it RAND 3000
+swap
+dm 100
+sort
+rh
+dm 100
+rt
+shuffle
+dm 100
+size
+free
@@ -0,0 +1,14 @@
+# Test of the lock-free single-producer/single-consumer queue against the
+# mutex-guarded one, with a full queue and with partial batches
+option fail 0
+option malloc 0
+option spsccap 2
+option spscbatch 1
+spsc 20000
+option spscbatch 7
+spsc 20001
+option spsccap 100
+option spscbatch 32
+spsc 50000
+spsc 0
+spsc 1
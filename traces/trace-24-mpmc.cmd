@@ -0,0 +1,10 @@
+# Test of the lock-free multi-producer/multi-consumer queue: elements must
+# all come out once, in the order of each producer, with up to 6 threads
+option fail 0
+option malloc 0
+option mpmcthreads 6
+mpmc 30000
+mpmc 5
+mpmc 0
+option mpmcthreads 1
+mpmc 1000
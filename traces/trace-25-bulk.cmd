@@ -0,0 +1,43 @@
+# Test of batch inserts and of draining the queue in batches
+option fail 0
+option malloc 0
+new
+ih a 3
+it b 2
+ih c
+rhq 2
+rh a
+rh a
+rh b
+rh b
+size
+it d 2000
+ih e 1500
+reverse
+rhq 1999
+rh d
+rh e
+rhq 1498
+rh e
+size
+it f 3
+ih g 2
+dm
+rhq 3
+rh f
+size
+rhq 10
+size
+free
+new
+it RAND 5000
+ih RAND 3000
+dm 3
+rhq 4000
+dm 3
+sort
+rhq 1000
+reverse
+rhq 2999
+size
+free
@@ -0,0 +1,49 @@
+# Test of inserts adopting the string and removes handing it back
+option fail 0
+option malloc 0
+new
+option take 1
+ih dolphin
+it bear
+ih gerbil 2
+option take 0
+it meerkat
+ih zebra
+option take 1
+rh zebra
+rh gerbil
+rt meerkat
+rt bear
+option take 0
+rh gerbil
+rh dolphin
+size
+option take 1
+it b 4
+it a
+ih c
+ih d 2
+option take 0
+it e
+sort
+dedup
+reverse
+swap
+dm
+rhq
+rt a
+size
+free
+new
+option take 1
+it RAND 500
+ih RAND 500
+option take 0
+it RAND 500
+sort
+rhq 700
+option take 1
+rh
+rt
+option take 0
+free
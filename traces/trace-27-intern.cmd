@@ -0,0 +1,45 @@
+# Test of queues sharing the storage of equal strings
+option fail 0
+option malloc 0
+new
+option intern 1
+ih dolphin
+it bear 2
+it gerbil
+option intern 0
+it bear
+ih gerbil
+intern
+sort
+dedup
+rh dolphin
+size
+option intern 1
+ih meerkat 40
+it RAND 200
+option take 1
+rh meerkat
+rt
+option take 0
+reverse
+sort
+dm
+swap
+dedup
+intern
+free
+intern
+new
+option intern 1
+it aardvark 3
+ih zebra 2
+it aardvark
+option intern 0
+it aardvark
+rh zebra
+rh zebra
+rh aardvark
+rhq 3
+rt aardvark
+size
+free
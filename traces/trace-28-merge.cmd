@@ -0,0 +1,243 @@
+# Test of merging sorted queues
+option fail 0
+option malloc 0
+new
+ih gerbil
+ih bear
+ih aardvark
+chain
+it bear
+it dolphin
+chain
+chain
+it cat
+it zebra
+merge
+size
+rh aardvark
+rh bear
+rh bear
+rh cat
+rh dolphin
+rh gerbil
+rh zebra
+merge
+# More queues than a loser tree takes, merged in two passes
+new
+ih k69
+it k69
+chain
+ih k68
+it k68
+chain
+ih k67
+it k67
+chain
+ih k66
+it k66
+chain
+ih k65
+it k65
+chain
+ih k64
+it k64
+chain
+ih k63
+it k63
+chain
+ih k62
+it k62
+chain
+ih k61
+it k61
+chain
+ih k60
+it k60
+chain
+ih k59
+it k59
+chain
+ih k58
+it k58
+chain
+ih k57
+it k57
+chain
+ih k56
+it k56
+chain
+ih k55
+it k55
+chain
+ih k54
+it k54
+chain
+ih k53
+it k53
+chain
+ih k52
+it k52
+chain
+ih k51
+it k51
+chain
+ih k50
+it k50
+chain
+ih k49
+it k49
+chain
+ih k48
+it k48
+chain
+ih k47
+it k47
+chain
+ih k46
+it k46
+chain
+ih k45
+it k45
+chain
+ih k44
+it k44
+chain
+ih k43
+it k43
+chain
+ih k42
+it k42
+chain
+ih k41
+it k41
+chain
+ih k40
+it k40
+chain
+ih k39
+it k39
+chain
+ih k38
+it k38
+chain
+ih k37
+it k37
+chain
+ih k36
+it k36
+chain
+ih k35
+it k35
+chain
+ih k34
+it k34
+chain
+ih k33
+it k33
+chain
+ih k32
+it k32
+chain
+ih k31
+it k31
+chain
+ih k30
+it k30
+chain
+ih k29
+it k29
+chain
+ih k28
+it k28
+chain
+ih k27
+it k27
+chain
+ih k26
+it k26
+chain
+ih k25
+it k25
+chain
+ih k24
+it k24
+chain
+ih k23
+it k23
+chain
+ih k22
+it k22
+chain
+ih k21
+it k21
+chain
+ih k20
+it k20
+chain
+ih k19
+it k19
+chain
+ih k18
+it k18
+chain
+ih k17
+it k17
+chain
+ih k16
+it k16
+chain
+ih k15
+it k15
+chain
+ih k14
+it k14
+chain
+ih k13
+it k13
+chain
+ih k12
+it k12
+chain
+ih k11
+it k11
+chain
+ih k10
+it k10
+chain
+ih k09
+it k09
+chain
+ih k08
+it k08
+chain
+ih k07
+it k07
+chain
+ih k06
+it k06
+chain
+ih k05
+it k05
+chain
+ih k04
+it k04
+chain
+ih k03
+it k03
+chain
+ih k02
+it k02
+chain
+ih k01
+it k01
+chain
+ih k00
+merge
+size
+rh k00
+rh k01
+rh k01
+rh k02
+rh k02
+free
+quit
@@ -0,0 +1,80 @@
+# Test of inserts, lookups and deletes on a sorted queue
+option fail 0
+option malloc 0
+new
+is gerbil
+is bear
+is dolphin
+is aardvark
+is bear
+is zebra
+size
+find bear
+find cat
+find zebra
+ds cat
+ds bear
+find bear
+ds bear 5
+find bear
+# Inserts at either end that keep the order
+ih aa
+it zz
+is cat
+is bear
+rh aa
+rt zz
+find gerbil
+# Changes out of order, then the queue is sorted again
+ih yak
+it ant
+sort
+is emu
+find yak
+find ant
+reverse
+sort
+is fox
+ds dolphin
+rh aardvark
+rh ant
+rh bear
+rh cat
+rh emu
+rh fox
+rh gerbil
+rh yak
+rh zebra
+size
+# Lookups and deletes on a queue out of order leave it as it is
+is mole
+is newt
+ih zebu
+find mole
+ds mole
+reverse
+find zebu
+sort
+is lynx
+find mole
+find zebu
+ds newt
+rh lynx
+rh mole
+rh zebu
+size
+# Many random strings, with duplicates found and deleted, then a string
+# sorting after all of them appended
+is RAND 3000
+is kiwi 50
+find kiwi
+ds kiwi 20
+find kiwi
+dm
+ds kiwi 100
+find kiwi
+it zzzzzzzzzz
+ds zzzzzzzzzz
+size
+free
+quit
@@ -0,0 +1,41 @@
+# Test of malloc failure on inserts of interned strings
+option fail 30
+option malloc 0
+option slab 2
+option intern 1
+new
+it a
+it a 14
+option malloc 100
+it a
+ih a
+is a
+option malloc 0
+it a 15
+option malloc 100
+it a
+ih a
+is a
+option malloc 0
+it a 30
+option malloc 100
+it a
+ih a
+is a
+option malloc 0
+free
+new
+it a
+it a 29
+option malloc 100
+it a
+is a
+option malloc 0
+ih a 30
+option malloc 100
+ih a
+option malloc 0
+intern
+free
+intern
+quit
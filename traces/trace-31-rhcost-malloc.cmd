@@ -0,0 +1,18 @@
+# Test of malloc failure on the elements rhcost puts back
+option fail 1000
+option malloc 0
+new
+ih dolphin 20
+it gerbil 20
+option malloc 10
+rhcost
+option malloc 0
+size
+it kiwi 10
+dm
+rh
+rt kiwi
+size
+rhcost 5
+free
+quit